@@ -0,0 +1,202 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_3DS) && !defined(_WIN32)
+#define ARCHIVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <ctype.h>
+#include "archive.h"
+#include "systemstub.h"
+
+
+Archive::Archive()
+	: _fp(0), _mapData(0), _mapSize(0), _toc(0), _names(0), _entriesCount(0), _lockStub(0), _lock(0) {
+}
+
+Archive::~Archive() {
+	close();
+}
+
+uint32 Archive::hashName(const char *name) {
+	uint32 hash = 2166136261U;
+	for (; *name; ++name) {
+		hash ^= (uint8)toupper((uint8)*name);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+bool Archive::open(const char *path) {
+	close();
+	uint8 hdr[HEADER_SIZE];
+#ifdef ARCHIVE_MMAP
+	// the whole file is mapped, the entries are read from the page cache
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= HEADER_SIZE) {
+		void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			_mapData = (uint8 *)p;
+			_mapSize = st.st_size;
+		}
+	}
+	::close(fd);
+	if (!_mapData) {
+		return false;
+	}
+	memcpy(hdr, _mapData, HEADER_SIZE);
+#else
+	// a single handle is kept opened, opening an entry does not touch the SD card
+	_fp = fopen(path, "rb");
+	if (!_fp) {
+		return false;
+	}
+	if (fread(hdr, 1, HEADER_SIZE, _fp) != HEADER_SIZE) {
+		close();
+		return false;
+	}
+#endif
+	if (memcmp(hdr, "FBPK", 4) != 0 || READ_LE_UINT16(hdr + 4) != VERSION) {
+		warning("Unsupported archive '%s'", path);
+		close();
+		return false;
+	}
+	_entriesCount = READ_LE_UINT32(hdr + 8);
+	const uint32 tocSize = READ_LE_UINT32(hdr + 12);
+	if (tocSize < (uint32)_entriesCount * ENTRY_SIZE) {
+		warning("Corrupted archive '%s'", path);
+		close();
+		return false;
+	}
+	if (_mapData) {
+		if (HEADER_SIZE + tocSize > _mapSize) {
+			warning("Truncated archive '%s'", path);
+			close();
+			return false;
+		}
+		_toc = _mapData + HEADER_SIZE;
+	} else {
+		_toc = (uint8 *)malloc(tocSize);
+		if (!_toc || fread(_toc, 1, tocSize, _fp) != tocSize) {
+			warning("Unable to read archive '%s' table of contents", path);
+			close();
+			return false;
+		}
+	}
+	_names = _toc + _entriesCount * ENTRY_SIZE;
+	debug(DBG_FILE, "Archive::open() '%s' entries %d", path, _entriesCount);
+	return true;
+}
+
+void Archive::close() {
+	if (_mapData) {
+#ifdef ARCHIVE_MMAP
+		munmap(_mapData, _mapSize);
+#endif
+		_mapData = 0;
+		_mapSize = 0;
+	} else {
+		free(_toc);
+	}
+	_toc = 0;
+	_names = 0;
+	_entriesCount = 0;
+	if (_fp) {
+		fclose(_fp);
+		_fp = 0;
+	}
+}
+
+// The entries are read through a single handle when the archive is not
+// mapped, the mutex is required as soon as several threads open files.
+void Archive::setLock(SystemStub *stub, void *mutex) {
+	_lockStub = stub;
+	_lock = mutex;
+}
+
+int Archive::findEntry(const char *name, uint32 flags) {
+	const char *sep = strrchr(name, '/');
+	if (sep) {
+		name = sep + 1;
+	}
+	const uint32 hash = hashName(name);
+	int lo = 0;
+	int hi = _entriesCount;
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if (READ_LE_UINT32(_toc + mid * ENTRY_SIZE) < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	for (; lo < _entriesCount; ++lo) {
+		const uint8 *entry = _toc + lo * ENTRY_SIZE;
+		if (READ_LE_UINT32(entry) != hash) {
+			break;
+		}
+		if (READ_LE_UINT32(entry + 16) == flags && strcasecmp((const char *)_names + READ_LE_UINT32(entry + 4), name) == 0) {
+			return lo;
+		}
+	}
+	return -1;
+}
+
+const char *Archive::getEntryName(int num) const {
+	return (const char *)_names + READ_LE_UINT32(_toc + num * ENTRY_SIZE + 4);
+}
+
+uint32 Archive::getEntrySize(int num) const {
+	return READ_LE_UINT32(_toc + num * ENTRY_SIZE + 12);
+}
+
+const uint8 *Archive::getEntryData(int num) const {
+	if (_mapData) {
+		return _mapData + READ_LE_UINT32(_toc + num * ENTRY_SIZE + 8);
+	}
+	return 0;
+}
+
+bool Archive::readEntry(int num, uint32 offset, void *ptr, uint32 len) {
+	const uint32 size = getEntrySize(num);
+	if (offset > size || len > size - offset) {
+		return false;
+	}
+	const uint32 pos = READ_LE_UINT32(_toc + num * ENTRY_SIZE + 8) + offset;
+	if (_mapData) {
+		if (pos + len > _mapSize) {
+			return false;
+		}
+		memcpy(ptr, _mapData + pos, len);
+		return true;
+	}
+	if (_lock) {
+		_lockStub->lockMutex(_lock);
+	}
+	const bool ret = fseek(_fp, pos, SEEK_SET) == 0 && fread(ptr, 1, len, _fp) == len;
+	if (_lock) {
+		_lockStub->unlockMutex(_lock);
+	}
+	return ret;
+}
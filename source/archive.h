@@ -0,0 +1,72 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCHIVE_H__
+#define ARCHIVE_H__
+
+#include "intern.h"
+
+struct SystemStub;
+
+// Single file holding all the data files, written by tools/fbpack.cpp.
+//
+// File layout, all values little endian :
+//
+//   header:  'FBPK', version u16, reserved u16, entries count u32, toc size u32
+//   toc:     entries sorted by hash, flags and name, then the names (0 terminated)
+//   entry:   hash u32 (of the upper cased name), name offset u32 (from the
+//            names start), data offset u32 (from the file start, multiple of
+//            DATA_ALIGN), size u32, flags u32
+//
+// The table of contents is used in place, without any parsing.
+struct Archive {
+	enum {
+		VERSION = 1,
+		HEADER_SIZE = 16,
+		ENTRY_SIZE = 20,
+		DATA_ALIGN = 32
+	};
+
+	enum {
+		ENTRY_UNPACKED = 1 << 0 // output of delphine_unpack() for the file of the same name
+	};
+
+	FILE *_fp;
+	uint8 *_mapData;
+	uint32 _mapSize;
+	uint8 *_toc;
+	const uint8 *_names;
+	int _entriesCount;
+	SystemStub *_lockStub;
+	void *_lock; // serializes the reads through _fp, see setLock()
+
+	Archive();
+	~Archive();
+
+	static uint32 hashName(const char *name);
+
+	bool open(const char *path);
+	void close();
+	void setLock(SystemStub *stub, void *mutex);
+	int findEntry(const char *name, uint32 flags);
+	const char *getEntryName(int num) const;
+	uint32 getEntrySize(int num) const;
+	const uint8 *getEntryData(int num) const;
+	bool readEntry(int num, uint32 offset, void *ptr, uint32 len);
+};
+
+#endif // ARCHIVE_H__
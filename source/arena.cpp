@@ -0,0 +1,82 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+
+static const uint32 kBlockHeaderSize = (sizeof(Arena::Block) + Arena::ALIGN - 1) & ~(Arena::ALIGN - 1);
+
+Arena::Arena()
+	: _blocks(0), _allocatedSize(0) {
+}
+
+Arena::~Arena() {
+	reset();
+}
+
+Arena::Block *Arena::allocateBlock(uint32 size) {
+	const uint32 blockSize = MAX(size, (uint32)BLOCK_SIZE);
+	Block *b = (Block *)malloc(kBlockHeaderSize + blockSize);
+	if (!b) {
+		error("Unable to allocate arena block (%d bytes)", blockSize);
+		return 0;
+	}
+	b->next = _blocks;
+	b->size = blockSize;
+	b->used = 0;
+	_blocks = b;
+	return b;
+}
+
+void *Arena::allocate(uint32 size) {
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	Block *b = _blocks;
+	if (!b || b->size - b->used < size) {
+		b = allocateBlock(size);
+		if (!b) {
+			return 0;
+		}
+	}
+	uint8 *p = (uint8 *)b + kBlockHeaderSize + b->used;
+	b->used += size;
+	_allocatedSize += size;
+	return p;
+}
+
+void Arena::reset() {
+	while (_blocks) {
+		Block *next = _blocks->next;
+		free(_blocks);
+		_blocks = next;
+	}
+	_allocatedSize = 0;
+}
+
+void Arena::rewind() {
+	if (_blocks && _blocks->next) {
+		// the allocations did not fit in one block, replace them with a block
+		// large enough for all of them, the next round should fit in it
+		uint32 size = 0;
+		for (Block *b = _blocks; b; b = b->next) {
+			size += b->size;
+		}
+		reset();
+		allocateBlock(size);
+	} else if (_blocks) {
+		_blocks->used = 0;
+	}
+	_allocatedSize = 0;
+}
@@ -0,0 +1,52 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H__
+#define ARENA_H__
+
+#include "intern.h"
+
+/*
+ * Bump allocator for data sharing the same lifetime. Memory is taken from
+ * malloc'ed blocks of at least BLOCK_SIZE bytes and only given back, all at
+ * once, by reset(). rewind() releases the allocations but keeps the memory
+ * for the next ones, in a single block.
+ */
+struct Arena {
+	enum {
+		BLOCK_SIZE = 16 * 1024,
+		ALIGN = 8
+	};
+
+	struct Block {
+		Block *next;
+		uint32 size, used;
+	};
+
+	Block *_blocks;
+	uint32 _allocatedSize;
+
+	Arena();
+	~Arena();
+
+	Block *allocateBlock(uint32 size);
+	void *allocate(uint32 size);
+	void reset();
+	void rewind();
+};
+
+#endif // ARENA_H__
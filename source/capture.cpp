@@ -0,0 +1,229 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "capture.h"
+#include "systemstub.h"
+
+
+static uint8 *writeUint16BE(uint8 *p, uint16 n) {
+	p[0] = n >> 8;
+	p[1] = n & 0xFF;
+	return p + 2;
+}
+
+static uint8 *writeUint32BE(uint8 *p, uint32 n) {
+	p = writeUint16BE(p, n >> 16);
+	return writeUint16BE(p, n & 0xFFFF);
+}
+
+Capture::Capture(SystemStub *stub)
+	: _stub(stub), _thread(0), _mutex(0), _ring(0), _frameBuf(0) {
+}
+
+Capture::~Capture() {
+	stop();
+}
+
+bool Capture::start(const char *filename, const char *directory, int w, int h, int blockW, int blockH) {
+	debug(DBG_VIDEO, "Capture::start('%s')", filename);
+	stop();
+	_w = w;
+	_h = h;
+	_blockW = blockW;
+	_blockH = blockH;
+	const int blocksCount = (w / blockW) * (h / blockH);
+	_ring = (uint8 *)malloc(RING_SIZE);
+	_frameBuf = (uint8 *)malloc(1 + 4 + NUM_PHASES * 4 + 32 + 256 * 3 + 2 + (blocksCount + 7) / 8 + w * h);
+	_mutex = _stub->createMutex();
+	if (!_ring || !_frameBuf || !_mutex) {
+		warning("Unable to allocate capture buffers");
+		stop();
+		return false;
+	}
+	if (!_f.open(filename, "wb", directory)) {
+		warning("Unable to open capture file '%s'", filename);
+		stop();
+		return false;
+	}
+	_f.writeUint32BE('FBCP');
+	_f.writeUint16BE(VERSION);
+	_f.writeUint16BE(w);
+	_f.writeUint16BE(h);
+	_f.writeByte(blockW);
+	_f.writeByte(blockH);
+	_ringHead = _ringTail = 0;
+	_quit = false;
+	_keyFrame = true;
+	memset(_phaseTimes, 0, sizeof(_phaseTimes));
+	_startTimeStamp = _stub->getTimeStamp();
+	_framesCount = _droppedFramesCount = 0;
+	_thread = _stub->createThread(writerThread, this);
+	if (!_thread) {
+		warning("Unable to create capture thread");
+		stop();
+		return false;
+	}
+	return true;
+}
+
+void Capture::stop() {
+	if (_thread) {
+		_stub->lockMutex(_mutex);
+		_quit = true;
+		_stub->unlockMutex(_mutex);
+		_stub->joinThread(_thread);
+		_thread = 0;
+		debug(DBG_INFO, "Captured %d frames, %d dropped", _framesCount, _droppedFramesCount);
+	}
+	_f.close();
+	if (_mutex) {
+		_stub->destroyMutex(_mutex);
+		_mutex = 0;
+	}
+	free(_ring);
+	_ring = 0;
+	free(_frameBuf);
+	_frameBuf = 0;
+}
+
+// dirtyBlocks is Video::_screenBlocks, a non zero entry means the block is
+// copied to the screen this frame. When null, the whole layer is written.
+void Capture::captureFrame(const uint8 *layer, int pitch, const uint8 *dirtyBlocks) {
+	if (!_thread) {
+		return;
+	}
+	const int bw = _w / _blockW;
+	const int bh = _h / _blockH;
+	const bool keyFrame = _keyFrame || !dirtyBlocks;
+	uint8 flags = keyFrame ? FLAG_KEYFRAME : 0;
+
+	uint8 *p = _frameBuf + 1;
+	p = writeUint32BE(p, _stub->getTimeStamp() - _startTimeStamp);
+	for (int i = 0; i < NUM_PHASES; ++i) {
+		p = writeUint32BE(p, _phaseTimes[i]);
+	}
+
+	// palette, a bitmask of the modified entries followed by their 6 bits colors
+	uint8 *mask = p;
+	memset(mask, 0, 32);
+	p += 32;
+	for (int i = 0; i < 256; ++i) {
+		Color c;
+		_stub->getPaletteEntry(i, &c);
+		uint8 *q = &_palette[i * 3];
+		if (keyFrame || q[0] != c.r || q[1] != c.g || q[2] != c.b) {
+			q[0] = c.r;
+			q[1] = c.g;
+			q[2] = c.b;
+			mask[i >> 3] |= 1 << (i & 7);
+			*p++ = c.r;
+			*p++ = c.g;
+			*p++ = c.b;
+		}
+	}
+	if (p != mask + 32) {
+		flags |= FLAG_PALETTE;
+	} else {
+		p = mask;
+	}
+
+	// blocks, a bitmask of the modified blocks followed by their pixels
+	uint8 *count = p;
+	p += 2;
+	mask = p;
+	memset(mask, 0, (bw * bh + 7) / 8);
+	p += (bw * bh + 7) / 8;
+	int n = 0;
+	for (int i = 0; i < bw * bh; ++i) {
+		if (keyFrame || dirtyBlocks[i] != 0) {
+			mask[i >> 3] |= 1 << (i & 7);
+			const uint8 *src = layer + (i / bw) * _blockH * pitch + (i % bw) * _blockW;
+			for (int y = 0; y < _blockH; ++y) {
+				memcpy(p, src, _blockW);
+				p += _blockW;
+				src += pitch;
+			}
+			++n;
+		}
+	}
+	writeUint16BE(count, n);
+	if (n == 0) {
+		p = count + 2;
+	}
+	_frameBuf[0] = flags;
+
+	++_framesCount;
+	if (pushData(_frameBuf, p - _frameBuf)) {
+		_keyFrame = false;
+	} else {
+		++_droppedFramesCount;
+		_keyFrame = true;
+	}
+}
+
+bool Capture::pushData(const uint8 *data, uint32 size) {
+	_stub->lockMutex(_mutex);
+	const uint32 tail = _ringTail;
+	_stub->unlockMutex(_mutex);
+	if (RING_SIZE - (_ringHead - tail) < size) {
+		return false;
+	}
+	// the writer thread does not touch [head, tail + RING_SIZE), the copy can
+	// be done without holding the lock
+	const uint32 offset = _ringHead % RING_SIZE;
+	const uint32 len = MIN(size, (uint32)RING_SIZE - offset);
+	memcpy(_ring + offset, data, len);
+	memcpy(_ring, data + len, size - len);
+	_stub->lockMutex(_mutex);
+	_ringHead += size;
+	_stub->unlockMutex(_mutex);
+	return true;
+}
+
+void Capture::flushRing() {
+	_stub->lockMutex(_mutex);
+	const uint32 head = _ringHead;
+	_stub->unlockMutex(_mutex);
+	while (_ringTail != head) {
+		const uint32 offset = _ringTail % RING_SIZE;
+		const uint32 len = MIN(head - _ringTail, (uint32)RING_SIZE - offset);
+		_f.write(_ring + offset, len);
+		_stub->lockMutex(_mutex);
+		_ringTail += len;
+		_stub->unlockMutex(_mutex);
+	}
+}
+
+void Capture::writerThread(void *param) {
+	Capture *c = (Capture *)param;
+	while (1) {
+		c->_stub->lockMutex(c->_mutex);
+		const bool quit = c->_quit;
+		const bool empty = (c->_ringHead == c->_ringTail);
+		c->_stub->unlockMutex(c->_mutex);
+		if (!empty) {
+			c->flushRing();
+		} else if (quit) {
+			break;
+		} else {
+			c->_stub->sleep(10);
+		}
+	}
+	if (c->_f.ioErr()) {
+		warning("I/O error when writing capture file");
+	}
+}
@@ -0,0 +1,77 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPTURE_H__
+#define CAPTURE_H__
+
+#include "intern.h"
+#include "file.h"
+
+struct SystemStub;
+
+/*
+ * Records the presented frames as the indexed 8x8 blocks that changed and
+ * the palette entries that changed, see tools/capture2ppm.cpp for the file
+ * layout. Frames are serialized into a ring buffer and written to disk by
+ * a background thread, a frame is dropped (and the next one written as a
+ * key frame) when the ring is full.
+ */
+struct Capture {
+	enum {
+		PHASE_LOGIC,
+		PHASE_DRAW,
+		PHASE_PRESENT,
+		PHASE_WAIT,
+		NUM_PHASES
+	};
+	enum {
+		VERSION = 1,
+		FLAG_KEYFRAME = 1 << 0,
+		FLAG_PALETTE = 1 << 1,
+		RING_SIZE = 512 * 1024
+	};
+
+	SystemStub *_stub;
+	File _f;
+	int _w, _h, _blockW, _blockH;
+	void *_thread;
+	void *_mutex;
+	uint8 *_ring;
+	uint32 _ringHead, _ringTail;
+	bool _quit;
+	bool _keyFrame;
+	uint8 *_frameBuf;
+	uint8 _palette[256 * 3];
+	uint32 _phaseTimes[NUM_PHASES];
+	uint32 _startTimeStamp;
+	uint32 _framesCount, _droppedFramesCount;
+
+	Capture(SystemStub *stub);
+	~Capture();
+
+	bool isActive() const { return _thread != 0; }
+	bool start(const char *filename, const char *directory, int w, int h, int blockW, int blockH);
+	void stop();
+	void setPhaseTime(int phase, uint32 us) { _phaseTimes[phase] = us; }
+	void captureFrame(const uint8 *layer, int pitch, const uint8 *dirtyBlocks);
+
+	bool pushData(const uint8 *data, uint32 size);
+	void flushRing();
+	static void writerThread(void *param);
+};
+
+#endif // CAPTURE_H__
@@ -17,26 +17,37 @@
 
 #include "mod_player.h"
 #include "resource.h"
+#include "frame_scheduler.h"
 #include "systemstub.h"
 #include "video.h"
 #include "cutscene.h"
 
 
-Cutscene::Cutscene(ModPlayer *ply, Resource *res, SystemStub *stub, Video *vid)
-	: _ply(ply), _res(res), _stub(stub), _vid(vid) {
+Cutscene::Cutscene(ModPlayer *ply, Resource *res, SystemStub *stub, Video *vid, FrameScheduler *frameSched)
+	: _ply(ply), _res(res), _stub(stub), _vid(vid), _frameSched(frameSched), _rotDataKey(~(uint64)0), _shapesPolData(0), _shapes(0), _cmdData(0), _rasterTimeUs(0),
+	_renderAhead(true), _workerActive(false), _worker(0), _framesMutex(0), _workerEvent(0), _presentEvent(0), _framesPages(0) {
 	memset(_palBuf, 0, sizeof(_palBuf));
+#ifdef CUTSCENE_NO_RENDER_AHEAD
+	_renderAhead = false;
+#endif
 }
 
 void Cutscene::sync() {
+	if (_workerActive) {
+		Frame *f = acquireFrame();
+		if (f) {
+			f->flags = FRAME_SYNC;
+			f->delay = _frameDelay * TIMER_SLICE;
+			commitFrame();
+		}
+		return;
+	}
 	// XXX input handling
 	if (!(_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE)) {
-		int32 delay = _stub->getTimeStamp() - _tstamp;
-		int32 pause = _frameDelay * TIMER_SLICE - delay;
-		if (pause > 0) {
-			_stub->sleep(pause);
-		}
+		_frameSched->waitFrame(_frameDelay * TIMER_SLICE * 1000);
+	} else {
+		_frameSched->reset();
 	}
-	_tstamp = _stub->getTimeStamp();
 }
 
 void Cutscene::copyPalette(const uint8 *pal, uint16 num) {
@@ -48,31 +59,64 @@ void Cutscene::copyPalette(const uint8 *pal, uint16 num) {
 	_newPal = true;
 }
 
+void Cutscene::applyPalette(const uint8 *palBuf) {
+	const uint8 *p = palBuf;
+	for (int i = 0; i < 32; ++i) {
+		uint16 color = READ_BE_UINT16(p); p += 2;
+		uint8 t = (color == 0) ? 0 : 3;
+		Color c;
+		c.r = ((color & 0xF00) >> 6) | t;
+		c.g = ((color & 0x0F0) >> 2) | t;
+		c.b = ((color & 0x00F) << 2) | t;
+		_stub->setPaletteEntry(0xC0 + i, &c);
+	}
+}
+
 void Cutscene::updatePalette() {
 	if (_newPal) {
-		const uint8 *p = _palBuf;
-		for (int i = 0; i < 32; ++i) {
-			uint16 color = READ_BE_UINT16(p); p += 2;
-			uint8 t = (color == 0) ? 0 : 3;
-			Color c;
-			c.r = ((color & 0xF00) >> 6) | t;
-			c.g = ((color & 0x0F0) >> 2) | t;
-			c.b = ((color & 0x00F) << 2) | t;
-			_stub->setPaletteEntry(0xC0 + i, &c);
-		}
+		applyPalette(_palBuf);
 		_newPal = false;
 	}
 }
 
 void Cutscene::setPalette() {
+	if (_workerActive) {
+		Frame *f = acquireFrame();
+		if (f) {
+			f->flags = FRAME_SYNC | FRAME_PAGE;
+			f->delay = _frameDelay * TIMER_SLICE;
+			if (_newPal) {
+				memcpy(f->palBuf, _palBuf, sizeof(_palBuf));
+				f->flags |= FRAME_PALETTE;
+				_newPal = false;
+			}
+			f->page = _page1;
+			commitFrame();
+			// instead of swapping, the next frame is drawn in a page that is not queued, with the content _page1 would have
+			uint8 *page = getFreePage();
+			copyPage(page, _page0);
+			_page0 = _page1;
+			_page1 = page;
+		}
+		return;
+	}
 	sync();
-	updatePalette();
 	SWAP(_page0, _page1);
-	_stub->copyRect(0, 0, Video::GAMESCREEN_W, Video::GAMESCREEN_H, _page0, 256);
-	_stub->updateScreen(0);
+	if (!_frameSched->_skipFrame) {
+		// a palette set on a skipped frame stays pending until the next presented one
+		updatePalette();
+		_stub->copyRect(0, 0, Video::GAMESCREEN_W, Video::GAMESCREEN_H, _page0, 256);
+		_stub->updateScreen(0);
+		_vid->digestLayer(_page0);
+	}
 }
 
 void Cutscene::initRotationData(uint16 a, uint16 b, uint16 c) {
+	const uint64 key = ((uint64)a << 32) | ((uint64)b << 16) | c;
+	if (key == _rotDataKey) {
+		return;
+	}
+	_rotDataKey = key;
 	int16 n1 = _sinTable[a];
 	int16 n2 = _cosTable[a];
 	int16 n3 = _sinTable[c];
@@ -125,6 +169,7 @@ void Cutscene::drawText(int16 x, int16 y, const uint8 *p, uint16 color, uint8 *p
 	if (n != 0) {
 		xx += ((last_sep - *sep++) & 0xFE) * 4;
 	}
+	int16 x1 = 0x7FFF, x2 = -1, y2 = -1;
 	for (; *p != 0xA; ++p) {
 		if (*p == 0x7C) {
 			yy += 8;
@@ -135,6 +180,9 @@ void Cutscene::drawText(int16 x, int16 y, const uint8 *p, uint16 color, uint8 *p
 		} else if (*p == 0x20) {
 			xx += 8;
 		} else {
+			x1 = MIN(x1, xx);
+			x2 = MAX(x2, xx + 7);
+			y2 = yy + 7;
 			uint8 *dst_char = page + 256 * yy + xx;
 			const uint8 *src = _res->_fnt + (*p - 32) * 32;
 			for (int h = 0; h < 8; ++h) {
@@ -156,14 +204,168 @@ void Cutscene::drawText(int16 x, int16 y, const uint8 *p, uint16 color, uint8 *p
 			xx += 8;
 		}
 	}
+	addPageDirtyRect(page, x1, y, x2, y2);
+}
+
+static void setRect(Cutscene::PageState *s, int16 x1, int16 y1, int16 x2, int16 y2) {
+	s->x1 = x1;
+	s->y1 = y1;
+	s->x2 = x2;
+	s->y2 = y2;
+}
+
+static void extendRect(Cutscene::PageState *s, const Cutscene::PageState *r) {
+	if (r->x1 > r->x2) {
+		return;
+	}
+	if (s->x1 > s->x2) {
+		setRect(s, r->x1, r->y1, r->x2, r->y2);
+	} else {
+		setRect(s, MIN(s->x1, r->x1), MIN(s->y1, r->y1), MAX(s->x2, r->x2), MAX(s->y2, r->y2));
+	}
+}
+
+static void copyPageRect(uint8 *dst, const uint8 *src, const Cutscene::PageState *r) {
+	if (r->x1 > r->x2) {
+		return;
+	}
+	const int offset = r->y1 * Video::GAMESCREEN_W + r->x1;
+	const int w = r->x2 - r->x1 + 1;
+	if (w == Video::GAMESCREEN_W) {
+		memcpy(dst + offset, src + offset, (r->y2 - r->y1 + 1) * Video::GAMESCREEN_W);
+		return;
+	}
+	dst += offset;
+	src += offset;
+	for (int y = r->y1; y <= r->y2; ++y) {
+		memcpy(dst, src, w);
+		dst += Video::GAMESCREEN_W;
+		src += Video::GAMESCREEN_W;
+	}
+}
+
+static void clearPageRect(uint8 *dst, const Cutscene::PageState *r) {
+	if (r->x1 > r->x2) {
+		return;
+	}
+	const int w = r->x2 - r->x1 + 1;
+	if (w == Video::GAMESCREEN_W) {
+		memset(dst + r->y1 * Video::GAMESCREEN_W, 0xC0, (r->y2 - r->y1 + 1) * Video::GAMESCREEN_W);
+		return;
+	}
+	dst += r->y1 * Video::GAMESCREEN_W + r->x1;
+	for (int y = r->y1; y <= r->y2; ++y) {
+		memset(dst, 0xC0, w);
+		dst += Video::GAMESCREEN_W;
+	}
+}
+
+static void resetPageState(Cutscene::PageState *s, const uint8 *page) {
+	s->page = page;
+	s->ref = Cutscene::PAGE_REF_NONE;
+	setRect(s, 0, 0, -1, -1);
+}
+
+void Cutscene::resetPageStates() {
+	resetPageState(&_pageStates[0], _page0);
+	resetPageState(&_pageStates[1], _page1);
+	_pagesCount = 2;
+	resetPageState(&_pageCState, _pageC);
+	_gfx.resetDirtyRect();
+}
+
+Cutscene::PageState *Cutscene::getPageState(const uint8 *page) {
+	for (int i = 0; i < _pagesCount; ++i) {
+		if (_pageStates[i].page == page) {
+			return &_pageStates[i];
+		}
+	}
+	return &_pageCState;
+}
+
+void Cutscene::addPageDirtyRect(const uint8 *page, int16 x1, int16 y1, int16 x2, int16 y2) {
+	PageState r;
+	setRect(&r, MAX(x1, 0), MAX(y1, 0), MIN(x2, Video::GAMESCREEN_W - 1), MIN(y2, Video::GAMESCREEN_H - 1));
+	if (r.x1 > r.x2 || r.y1 > r.y2) {
+		return;
+	}
+	extendRect(getPageState(page), &r);
+	if (page == _pageC) {
+		// the pages referencing _pageC now also differ in that area
+		for (int i = 0; i < _pagesCount; ++i) {
+			if (_pageStates[i].ref == PAGE_REF_PAGEC) {
+				extendRect(&_pageStates[i], &r);
+			}
+		}
+	}
+}
+
+void Cutscene::addShapesDirtyRect() {
+	if (_gfx._dirtyX1 <= _gfx._dirtyX2) {
+		addPageDirtyRect(_page1, _gfx._crx + _gfx._dirtyX1, _gfx._cry + _gfx._dirtyY1, _gfx._crx + _gfx._dirtyX2, _gfx._cry + _gfx._dirtyY2);
+		_gfx.resetDirtyRect();
+	}
+}
+
+// Copies a page, restricted to the area where the two pages may differ when
+// their content is known relative to the background or to a cleared page.
+void Cutscene::copyPage(uint8 *dst, const uint8 *src) {
+	PageState *d = getPageState(dst);
+	PageState *s = getPageState(src);
+	PageState r;
+	if (dst == _pageC && s->ref == PAGE_REF_PAGEC) {
+		r = *s;
+	} else if (src == _pageC && d->ref == PAGE_REF_PAGEC) {
+		r = *d;
+	} else if (d->ref == s->ref && d->ref != PAGE_REF_NONE) {
+		r = *d;
+		extendRect(&r, s);
+	} else {
+		setRect(&r, 0, 0, Video::GAMESCREEN_W - 1, Video::GAMESCREEN_H - 1);
+	}
+	copyPageRect(dst, src, &r);
+	if (dst == _pageC) {
+		if (s->ref == PAGE_REF_PAGEC) {
+			extendRect(d, &r);
+		} else {
+			d->ref = s->ref;
+			setRect(d, s->x1, s->y1, s->x2, s->y2);
+		}
+		for (int i = 0; i < _pagesCount; ++i) {
+			if (&_pageStates[i] != s && _pageStates[i].ref == PAGE_REF_PAGEC) {
+				extendRect(&_pageStates[i], &r);
+			}
+		}
+		s->ref = PAGE_REF_PAGEC;
+		setRect(s, 0, 0, -1, -1);
+	} else if (src == _pageC) {
+		d->ref = PAGE_REF_PAGEC;
+		setRect(d, 0, 0, -1, -1);
+	} else {
+		d->ref = s->ref;
+		setRect(d, s->x1, s->y1, s->x2, s->y2);
+	}
+}
+
+void Cutscene::clearPage(uint8 *page) {
+	PageState *s = getPageState(page);
+	if (s->ref == PAGE_REF_CLEAR) {
+		clearPageRect(page, s);
+	} else {
+		memset(page, 0xC0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+	}
+	s->ref = PAGE_REF_CLEAR;
+	setRect(s, 0, 0, -1, -1);
 }
 
 void Cutscene::swapLayers() {
+	const uint32 rasterStart = _stub->getTimeStampUs();
 	if (_clearScreen == 0) {
-		memcpy(_page1, _pageC, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		copyPage(_page1, _pageC);
 	} else {
-		memset(_page1, 0xC0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		clearPage(_page1);
 	}
+	_rasterTimeUs += _stub->getTimeStampUs() - rasterStart;
 }
 
 void Cutscene::drawCreditsText() {
@@ -210,6 +412,7 @@ void Cutscene::drawCreditsText() {
 
 void Cutscene::drawProtectionShape(uint8 shapeNum, int16 zoom) {
 	debug(DBG_CUT, "Cutscene::drawProtectionShape() shapeNum = %d", shapeNum);
+	const uint32 rasterStart = _stub->getTimeStampUs();
 	_shape_ix = 64;
 	_shape_iy = 64;
 	_shape_count = 0;
@@ -219,34 +422,25 @@ void Cutscene::drawProtectionShape(uint8 shapeNum, int16 zoom) {
 	zoom += 512;
 	initRotationData(0, 180, 90);
 
-	const uint8 *shapeOffsetTable    = _protectionShapeData + READ_BE_UINT16(_protectionShapeData + 0x02);
-	const uint8 *shapeDataTable      = _protectionShapeData + READ_BE_UINT16(_protectionShapeData + 0x0E);
-	const uint8 *verticesOffsetTable = _protectionShapeData + READ_BE_UINT16(_protectionShapeData + 0x0A);
-	const uint8 *verticesDataTable   = _protectionShapeData + READ_BE_UINT16(_protectionShapeData + 0x12);
-
+	if (_shapesPolData != _protectionShapeData) {
+		compileShapes(_protectionShapeData, 0);
+	}
 	++shapeNum;
-	const uint8 *shapeData = shapeDataTable + READ_BE_UINT16(shapeOffsetTable + (shapeNum & 0x7FF) * 2);
-	uint16 primitiveCount = READ_BE_UINT16(shapeData); shapeData += 2;
-
-	while (primitiveCount--) {
-		uint16 verticesOffset = READ_BE_UINT16(shapeData); shapeData += 2;
-		const uint8 *p = verticesDataTable + READ_BE_UINT16(verticesOffsetTable + (verticesOffset & 0x3FFF) * 2);
-		int16 dx = 0;
-		int16 dy = 0;
-		if (verticesOffset & 0x8000) {
-			dx = READ_BE_UINT16(shapeData); shapeData += 2;
-			dy = READ_BE_UINT16(shapeData); shapeData += 2;
-		}
-		_hasAlphaColor = (verticesOffset & 0x4000) != 0;
-		_primitiveColor = 0xC0 + *shapeData++;
-		drawShapeScaleRotate(p, zoom, dx, dy, x, y, 0, 0);
+	const CutsceneShape *shape = getShape(shapeNum & 0x7FF);
+	for (int i = 0; i < shape->primitivesCount; ++i) {
+		const CutscenePrimitive *prim = &shape->primitives[i];
+		_hasAlphaColor = prim->hasAlphaColor;
+		_primitiveColor = 0xC0 + prim->color;
+		drawShapeScaleRotate(prim, zoom, prim->dx, prim->dy, x, y, 0, 0);
 		++_shape_count;
 	}
+	addShapesDirtyRect();
+	_rasterTimeUs += _stub->getTimeStampUs() - rasterStart;
 }
 
 void Cutscene::op_markCurPos() {
 	debug(DBG_CUT, "Cutscene::op_markCurPos()");
-	_cmdPtrBak = _cmdPtr;
+	_cmdMark = _cmdPc;
 	drawCreditsText();
 	_frameDelay = 5;
 	setPalette();
@@ -256,7 +450,7 @@ void Cutscene::op_markCurPos() {
 
 void Cutscene::op_refreshScreen() {
 	debug(DBG_CUT, "Cutscene::op_refreshScreen()");
-	_clearScreen = fetchNextCmdByte();
+	_clearScreen = _cmdInsn->args[0];
 	if (_clearScreen != 0) {
 		swapLayers();
 		_varText = 0;
@@ -266,113 +460,218 @@ void Cutscene::op_refreshScreen() {
 void Cutscene::op_waitForSync() {
 	debug(DBG_CUT, "Cutscene::op_waitForSync()");
 	if (_creditsSequence) {
-		uint16 n = fetchNextCmdByte() * 2;
+		uint16 n = _cmdInsn->args[0] * 2;
 		do {
 			_varText = 0xFF;
 			_frameDelay = 3;
 			if (_textBuf == _textCurBuf) {
 				_creditsTextCounter = 20;
 			}
-			memcpy(_page1, _page0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+			copyPage(_page1, _page0);
 			drawCreditsText();
 			setPalette();
 		} while (--n);
 		swapLayers();
 		_varText = 0;
 	} else {
-		_frameDelay = fetchNextCmdByte() * 4;
+		_frameDelay = _cmdInsn->args[0] * 4;
 		sync(); // XXX handle input
 	}
 }
 
-void Cutscene::drawShape(const uint8 *data, int16 x, int16 y) {
+static bool isOutsidePolData(uint32 offset, uint32 len, int polLen) {
+	return polLen > 0 && offset + len > (uint32)polLen;
+}
+
+// Decodes the primitives of a shape, polLen is 0 when the size of the data
+// is unknown and the offsets are then not checked.
+const CutsceneShape *Cutscene::compileShape(const uint8 *polData, int polLen, uint16 num) {
+	const uint32 shapeOffsetTable    = READ_BE_UINT16(polData + 0x02);
+	const uint32 verticesOffsetTable = READ_BE_UINT16(polData + 0x0A);
+	const uint32 shapeDataTable      = READ_BE_UINT16(polData + 0x0E);
+	const uint32 verticesDataTable   = READ_BE_UINT16(polData + 0x12);
+
+	if (isOutsidePolData(shapeOffsetTable + num * 2, 2, polLen)) {
+		return 0;
+	}
+	uint32 offset = shapeDataTable + READ_BE_UINT16(polData + shapeOffsetTable + num * 2);
+	if (isOutsidePolData(offset, 2, polLen)) {
+		return 0;
+	}
+	const uint16 primitivesCount = READ_BE_UINT16(polData + offset); offset += 2;
+	CutscenePrimitive *primitives = (CutscenePrimitive *)_shapesArena.allocate(primitivesCount * sizeof(CutscenePrimitive));
+	for (int i = 0; i < primitivesCount; ++i) {
+		CutscenePrimitive *prim = &primitives[i];
+		if (isOutsidePolData(offset, 2, polLen)) {
+			return 0;
+		}
+		const uint16 verticesOffset = READ_BE_UINT16(polData + offset); offset += 2;
+		prim->dx = 0;
+		prim->dy = 0;
+		if (verticesOffset & 0x8000) {
+			if (isOutsidePolData(offset, 4, polLen)) {
+				return 0;
+			}
+			prim->dx = READ_BE_UINT16(polData + offset); offset += 2;
+			prim->dy = READ_BE_UINT16(polData + offset); offset += 2;
+		}
+		if (isOutsidePolData(offset, 1, polLen)) {
+			return 0;
+		}
+		prim->hasAlphaColor = (verticesOffset & 0x4000) != 0;
+		prim->color = polData[offset++];
+
+		const uint32 verticesEntry = verticesOffsetTable + (verticesOffset & 0x3FFF) * 2;
+		if (isOutsidePolData(verticesEntry, 2, polLen)) {
+			return 0;
+		}
+		const uint32 verticesData = verticesDataTable + READ_BE_UINT16(polData + verticesEntry);
+		if (isOutsidePolData(verticesData, 5, polLen)) {
+			return 0;
+		}
+		const uint8 *p = polData + verticesData;
+		const uint8 numVertices = *p++;
+		int16 *v;
+		if (numVertices & 0x80) {
+			if (isOutsidePolData(verticesData, 9, polLen)) {
+				return 0;
+			}
+			prim->type = CutscenePrimitive::TYPE_ELLIPSE;
+			prim->numVertices = 1;
+			v = (int16 *)_shapesArena.allocate(4 * sizeof(int16));
+			for (int j = 0; j < 4; ++j) {
+				v[j] = READ_BE_UINT16(p + j * 2);
+			}
+		} else if (numVertices == 0) {
+			prim->type = CutscenePrimitive::TYPE_POINT;
+			prim->numVertices = 1;
+			v = (int16 *)_shapesArena.allocate(2 * sizeof(int16));
+			v[0] = READ_BE_UINT16(p);
+			v[1] = READ_BE_UINT16(p + 2);
+		} else {
+			if (isOutsidePolData(verticesData, 5 + numVertices * 2, polLen)) {
+				return 0;
+			}
+			prim->type = CutscenePrimitive::TYPE_POLYGON;
+			v = (int16 *)_shapesArena.allocate((numVertices + 1) * 2 * sizeof(int16));
+			int16 ix = READ_BE_UINT16(p); p += 2;
+			int16 iy = READ_BE_UINT16(p); p += 2;
+			v[0] = ix;
+			v[1] = iy;
+			int count = 1;
+			for (int16 n = numVertices - 1; n >= 0; --n) {
+				const int16 dx = (int8)*p++;
+				const int16 dy = (int8)*p++;
+				ix += dx;
+				// an horizontal delta followed by another one is merged with it
+				if (dy == 0 && n != 0 && *(p + 1) == 0) {
+					continue;
+				}
+				iy += dy;
+				v[count * 2] = ix;
+				v[count * 2 + 1] = iy;
+				++count;
+			}
+			prim->numVertices = count;
+		}
+		prim->vertices = v;
+	}
+	CutsceneShape *shape = (CutsceneShape *)_shapesArena.allocate(sizeof(CutsceneShape));
+	shape->primitivesCount = primitivesCount;
+	shape->primitives = primitives;
+	return shape;
+}
+
+void Cutscene::compileShapes(const uint8 *polData, int polLen) {
+	_shapesArena.reset();
+	_shapesPolData = polData;
+	_shapes = (const CutsceneShape **)_shapesArena.allocate(MAX_SHAPES * sizeof(CutsceneShape *));
+	memset(_shapes, 0, MAX_SHAPES * sizeof(CutsceneShape *));
+	if (polLen < 0x14) {
+		return;
+	}
+	// the shape offsets table ends where the next section starts
+	const int shapeOffsetTable = READ_BE_UINT16(polData + 0x02);
+	int end = polLen;
+	for (int i = 0x06; i <= 0x12; i += 4) {
+		const int offset = READ_BE_UINT16(polData + i);
+		if (offset > shapeOffsetTable && offset < end) {
+			end = offset;
+		}
+	}
+	const int count = MIN((end - shapeOffsetTable) / 2, (int)MAX_SHAPES);
+	int compiledCount = 0;
+	for (int num = 0; num < count; ++num) {
+		_shapes[num] = compileShape(polData, polLen, num);
+		if (_shapes[num]) {
+			++compiledCount;
+		}
+	}
+	debug(DBG_CUT, "Cutscene::compileShapes() %d/%d shapes, %d bytes", compiledCount, count, _shapesArena._allocatedSize);
+}
+
+const CutsceneShape *Cutscene::getShape(uint16 num) {
+	if (!_shapes[num]) {
+		// not found when loading, parse it unchecked as the original code
+		_shapes[num] = compileShape(_shapesPolData, 0, num);
+	}
+	return _shapes[num];
+}
+
+void Cutscene::drawShape(const CutscenePrimitive *prim, int16 x, int16 y) {
 	debug(DBG_CUT, "Cutscene::drawShape()");
 	_gfx._layer = _page1;
-	uint8 numVertices = *data++;
-	if (numVertices & 0x80) {
+	const int16 *v = prim->vertices;
+	if (prim->type == CutscenePrimitive::TYPE_ELLIPSE) {
 		Point pt;
-		pt.x = READ_BE_UINT16(data) + x; data += 2;
-		pt.y = READ_BE_UINT16(data) + y; data += 2;
-		uint16 rx = READ_BE_UINT16(data); data += 2;
-		uint16 ry = READ_BE_UINT16(data); data += 2;
-		_gfx.drawEllipse(_primitiveColor, _hasAlphaColor, &pt, rx, ry);
-	} else if (numVertices == 0) {
+		pt.x = v[0] + x;
+		pt.y = v[1] + y;
+		_gfx.drawEllipse(_primitiveColor, _hasAlphaColor, &pt, v[2], v[3]);
+	} else if (prim->type == CutscenePrimitive::TYPE_POINT) {
 		Point pt;
-		pt.x = READ_BE_UINT16(data) + x; data += 2;
-		pt.y = READ_BE_UINT16(data) + y; data += 2;
+		pt.x = v[0] + x;
+		pt.y = v[1] + y;
 		_gfx.drawPoint(_primitiveColor, &pt);
 	} else {
-		Point *pt = _vertices;
-		int16 ix = READ_BE_UINT16(data); data += 2;
-		int16 iy = READ_BE_UINT16(data); data += 2;
-		pt->x = ix + x;
-		pt->y = iy + y;
-		++pt;
-		int16 n = numVertices - 1;
-		++numVertices;
-		for (; n >= 0; --n) {
-			int16 dx = (int8)*data++;
-			int16 dy = (int8)*data++;
-			if (dy == 0 && n != 0 && *(data + 1) == 0) {
-				ix += dx;
-				--numVertices;
-			} else {
-				ix += dx;
-				iy += dy;
-				pt->x = ix + x;
-				pt->y = iy + y;
-				++pt;
-			}
+		for (int i = 0; i < prim->numVertices; ++i) {
+			_vertices[i].x = v[i * 2] + x;
+			_vertices[i].y = v[i * 2 + 1] + y;
 		}
-		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, numVertices);
+		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, prim->numVertices);
 	}
 }
 
 void Cutscene::op_drawShape() {
 	debug(DBG_CUT, "Cutscene::op_drawShape()");
+	const uint32 rasterStart = _stub->getTimeStampUs();
 
-	int16 x = 0;
-	int16 y = 0;
-	uint16 shapeOffset = fetchNextCmdWord();
-	if (shapeOffset & 0x8000) {
-		x = fetchNextCmdWord();
-		y = fetchNextCmdWord();
-	}
-
-	const uint8 *shapeOffsetTable    = _polPtr + READ_BE_UINT16(_polPtr + 0x02);
-	const uint8 *shapeDataTable      = _polPtr + READ_BE_UINT16(_polPtr + 0x0E);
-	const uint8 *verticesOffsetTable = _polPtr + READ_BE_UINT16(_polPtr + 0x0A);
-	const uint8 *verticesDataTable   = _polPtr + READ_BE_UINT16(_polPtr + 0x12);
-
-	const uint8 *shapeData = shapeDataTable + READ_BE_UINT16(shapeOffsetTable + (shapeOffset & 0x7FF) * 2);
-	uint16 primitiveCount = READ_BE_UINT16(shapeData); shapeData += 2;
+	const int16 *args = _cmdInsn->args;
+	uint16 shapeOffset = args[0];
+	int16 x = args[1];
+	int16 y = args[2];
 
-	while (primitiveCount--) {
-		uint16 verticesOffset = READ_BE_UINT16(shapeData); shapeData += 2;
-		const uint8 *primitiveVertices = verticesDataTable + READ_BE_UINT16(verticesOffsetTable + (verticesOffset & 0x3FFF) * 2);
-		int16 dx = 0;
-		int16 dy = 0;
-		if (verticesOffset & 0x8000) {
-			dx = READ_BE_UINT16(shapeData); shapeData += 2;
-			dy = READ_BE_UINT16(shapeData); shapeData += 2;
-		}
-		_hasAlphaColor = (verticesOffset & 0x4000) != 0;
-		uint8 color = *shapeData++;
+	const CutsceneShape *shape = getShape(shapeOffset & 0x7FF);
+	for (int i = 0; i < shape->primitivesCount; ++i) {
+		const CutscenePrimitive *prim = &shape->primitives[i];
+		_hasAlphaColor = prim->hasAlphaColor;
+		uint8 color = prim->color;
 		if (_clearScreen == 0) {
 			color += 0x10;
 		}
 		_primitiveColor = 0xC0 + color;
-		drawShape(primitiveVertices, x + dx, y + dy);
+		drawShape(prim, x + prim->dx, y + prim->dy);
 	}
+	addShapesDirtyRect();
 	if (_clearScreen != 0) {
-		memcpy(_pageC, _page1, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		copyPage(_pageC, _page1);
 	}
+	_rasterTimeUs += _stub->getTimeStampUs() - rasterStart;
 }
 
 void Cutscene::op_setPalette() {
 	debug(DBG_CUT, "Cutscene::op_setPalette()");
-	uint8 num = fetchNextCmdByte();
-	uint8 palNum = fetchNextCmdByte();
+	uint8 num = _cmdInsn->args[0];
+	uint8 palNum = _cmdInsn->args[1];
 	uint16 off = READ_BE_UINT16(_polPtr + 6);
 	const uint8 *p = _polPtr + off + num * 32;
 	copyPalette(p, palNum ^ 1);
@@ -384,11 +683,17 @@ void Cutscene::op_setPalette() {
 
 void Cutscene::op_drawStringAtBottom() {
 	debug(DBG_CUT, "Cutscene::op_drawStringAtBottom()");
-	uint16 strId = fetchNextCmdWord();
+	uint16 strId = _cmdInsn->args[0];
 	if (!_creditsSequence) {
+		if (_workerActive) {
+			detachPage0();
+		}
 		memset(_pageC + 179 * 256, 0xC0, 45 * 256);
 		memset(_page1 + 179 * 256, 0xC0, 45 * 256);
 		memset(_page0 + 179 * 256, 0xC0, 45 * 256);
+		addPageDirtyRect(_pageC, 0, 179, 255, 223);
+		addPageDirtyRect(_page1, 0, 179, 255, 223);
+		addPageDirtyRect(_page0, 0, 179, 255, 223);
 		if (strId != 0xFFFF) {
 			const uint8 *str = _res->getCineString(strId);
 			if (str) {
@@ -405,7 +710,6 @@ void Cutscene::op_nop() {
 
 void Cutscene::op_skip3() {
 	debug(DBG_CUT, "Cutscene::op_skip3()");
-	_cmdPtr += 3;
 }
 
 void Cutscene::op_refreshAll() {
@@ -417,18 +721,57 @@ void Cutscene::op_refreshAll() {
 	op_handleKeys();
 }
 
-void Cutscene::drawShapeScale(const uint8 *data, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g) {
+// Translates the vertices by (b, c) into the xs and ys arrays and, when rotData
+// is not null, rotates them around (cx, cy). The arithmetic and the int16
+// truncation of the results match the per vertex code this replaces.
+static void transformVertices(const int16 *v, int count, int16 b, int16 c, const uint32 *rotData, int16 cx, int16 cy, int32 *xs, int32 *ys) {
+	if (!rotData) {
+		for (int i = 0; i < count; ++i) {
+			xs[i] = (int16)(b + v[i * 2]);
+			ys[i] = (int16)(c + v[i * 2 + 1]);
+		}
+	} else {
+		const uint32 r0 = rotData[0];
+		const uint32 r1 = rotData[1];
+		const uint32 r2 = rotData[2];
+		const uint32 r3 = rotData[3];
+		for (int i = 0; i < count; ++i) {
+			const uint32 rx = cx - (int16)(b + v[i * 2]);
+			const uint32 ry = cy - (int16)(c + v[i * 2 + 1]);
+			xs[i] = (int16)(cx + ((r0 * rx + r1 * ry) >> 8));
+			ys[i] = (int16)(cy + ((r2 * rx + r3 * ry) >> 8));
+		}
+	}
+}
+
+// Scales the deltas between the transformed vertices, accumulated in 16.16
+// from (*x16, *y16), and stores the vertices 1 to count - 1 offset by (tx, ty).
+static void scaleVertices(const int32 *xs, const int32 *ys, int count, int16 zoom, uint32 *x16, uint32 *y16, int16 tx, int16 ty, Point *pts) {
+	const uint32 scale = zoom * 128;
+	uint32 x = *x16;
+	uint32 y = *y16;
+	for (int i = 1; i < count; ++i) {
+		x += (uint32)(int16)(xs[i] - xs[i - 1]) * scale;
+		y += (uint32)(int16)(ys[i] - ys[i - 1]) * scale;
+		pts[i - 1].x = tx + ((x + 0x8000) >> 16);
+		pts[i - 1].y = ty + ((y + 0x8000) >> 16);
+	}
+	*x16 = x;
+	*y16 = y;
+}
+
+void Cutscene::drawShapeScale(const CutscenePrimitive *prim, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g) {
 	debug(DBG_CUT, "Cutscene::drawShapeScale(%d, %d, %d, %d, %d, %d, %d)", zoom, b, c, d, e, f, g);
 	_gfx._layer = _page1;
-	uint8 numVertices = *data++;
-	if (numVertices & 0x80) {
+	const int16 *v = prim->vertices;
+	if (prim->type == CutscenePrimitive::TYPE_ELLIPSE) {
 		int16 x, y;
 		Point *pt = _vertices;
 		Point pr[2];
-		_shape_cur_x = b + READ_BE_UINT16(data); data += 2;
-		_shape_cur_y = c + READ_BE_UINT16(data); data += 2;
-		x = READ_BE_UINT16(data); data += 2;
-		y = READ_BE_UINT16(data); data += 2;
+		_shape_cur_x = b + v[0];
+		_shape_cur_y = c + v[1];
+		x = v[2];
+		y = v[3];
 		_shape_cur_x16 = 0;
 		_shape_cur_y16 = 0;
 		pr[0].x =  0;
@@ -469,10 +812,10 @@ void Cutscene::drawShapeScale(const uint8 *data, int16 zoom, int16 b, int16 c, i
 		int16 rx = _vertices[0].x - _vertices[2].x;
 		int16 ry = _vertices[0].y - _vertices[1].y;
 		_gfx.drawEllipse(_primitiveColor, _hasAlphaColor, &po, rx, ry);
-	} else if (numVertices == 0) {
+	} else if (prim->type == CutscenePrimitive::TYPE_POINT) {
 		Point pt;
- 		pt.x = _shape_cur_x = b + READ_BE_UINT16(data); data += 2;
-	 	pt.y = _shape_cur_y = c + READ_BE_UINT16(data); data += 2;
+		pt.x = _shape_cur_x = b + v[0];
+		pt.y = _shape_cur_y = c + v[1];
  		if (_shape_count == 0) {
 			f -= ((((_shape_ix - pt.x) * zoom) * 128) + 0x8000) >> 16;
 			g -= ((((_shape_iy - pt.y) * zoom) * 128) + 0x8000) >> 16;
@@ -494,8 +837,10 @@ void Cutscene::drawShapeScale(const uint8 *data, int16 zoom, int16 b, int16 c, i
 	} else {
 		Point *pt = _vertices;
 		int16 ix, iy;
-		_shape_cur_x = ix = READ_BE_UINT16(data) + b; data += 2;
-		_shape_cur_y = iy = READ_BE_UINT16(data) + c; data += 2;
+		int32 xs[0x80], ys[0x80];
+		transformVertices(v, prim->numVertices, b, c, 0, 0, 0, xs, ys);
+		_shape_cur_x = ix = xs[0];
+		_shape_cur_y = iy = ys[0];
 		if (_shape_count == 0) {
 			f -= ((((_shape_ix - _shape_ox) * zoom) * 128) + 0x8000) >> 16;
 			g -= ((((_shape_iy - _shape_oy) * zoom) * 128) + 0x8000) >> 16;
@@ -511,107 +856,66 @@ void Cutscene::drawShapeScale(const uint8 *data, int16 zoom, int16 b, int16 c, i
 			pt->y = iy = ((_shape_cur_y16 + 0x8000) >> 16) + _shape_iy + e;
 			++pt;
 		}
-		int16 n = numVertices - 1;
-		++numVertices;
-		int16 sx = 0;
-		for (; n >= 0; --n) {
-			ix = (int8)(*data++) + sx;
-			iy = (int8)(*data++);
-			if (iy == 0 && n != 0 && *(data + 1) == 0) {
-				sx = ix;
-				--numVertices;
-			} else {
-				sx = 0;
-				_shape_cur_x += ix;
-				_shape_cur_y += iy;
-				_shape_cur_x16 += ix * zoom * 128;
-				_shape_cur_y16 += iy * zoom * 128;
-				pt->x = ((_shape_cur_x16 + 0x8000) >> 16) + _shape_ix + d;
-				pt->y = ((_shape_cur_y16 + 0x8000) >> 16) + _shape_iy + e;
-				++pt;
-			}
-		}
+		scaleVertices(xs, ys, prim->numVertices, zoom, &_shape_cur_x16, &_shape_cur_y16, _shape_ix + d, _shape_iy + e, pt);
+		_shape_cur_x = xs[prim->numVertices - 1];
+		_shape_cur_y = ys[prim->numVertices - 1];
 		_shape_prev_x = _shape_cur_x;
 		_shape_prev_y = _shape_cur_y;
 		_shape_prev_x16 = _shape_cur_x16;
 		_shape_prev_y16 = _shape_cur_y16;
-		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, numVertices);
+		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, prim->numVertices);
 	}
 }
 
 void Cutscene::op_drawShapeScale() {
 	debug(DBG_CUT, "Cutscene::op_drawShapeScale()");
+	const uint32 rasterStart = _stub->getTimeStampUs();
 
 	_shape_count = 0;
 
-	int16 x = 0;
-	int16 y = 0;
-	uint16 shapeOffset = fetchNextCmdWord();
-	if (shapeOffset & 0x8000) {
-		x = fetchNextCmdWord();
-		y = fetchNextCmdWord();
-	}
-
-	uint16 zoom = fetchNextCmdWord() + 512;
-	_shape_ix = fetchNextCmdByte();
-	_shape_iy = fetchNextCmdByte();
-
-	const uint8 *shapeOffsetTable    = _polPtr + READ_BE_UINT16(_polPtr + 0x02);
-	const uint8 *shapeDataTable      = _polPtr + READ_BE_UINT16(_polPtr + 0x0E);
-	const uint8 *verticesOffsetTable = _polPtr + READ_BE_UINT16(_polPtr + 0x0A);
-	const uint8 *verticesDataTable   = _polPtr + READ_BE_UINT16(_polPtr + 0x12);
+	const int16 *args = _cmdInsn->args;
+	uint16 shapeOffset = args[0];
+	int16 x = args[1];
+	int16 y = args[2];
+	uint16 zoom = args[3] + 512;
+	_shape_ix = args[4];
+	_shape_iy = args[5];
 
-	const uint8 *shapeData = shapeDataTable + READ_BE_UINT16(shapeOffsetTable + (shapeOffset & 0x7FF) * 2);
-	uint16 primitiveCount = READ_BE_UINT16(shapeData); shapeData += 2;
-
-	if (primitiveCount != 0) {
-		uint16 verticesOffset = READ_BE_UINT16(shapeData);
-		int16 dx = 0;
-		int16 dy = 0;
-		if (verticesOffset & 0x8000) {
-			dx = READ_BE_UINT16(shapeData + 2);
-			dy = READ_BE_UINT16(shapeData + 4);
-		}
-		const uint8 *p = verticesDataTable + READ_BE_UINT16(verticesOffsetTable + (verticesOffset & 0x3FFF) * 2) + 1;
-		_shape_ox = READ_BE_UINT16(p) + dx; p += 2;
-		_shape_oy = READ_BE_UINT16(p) + dy; p += 2;
-		while (primitiveCount--) {
-			verticesOffset = READ_BE_UINT16(shapeData); shapeData += 2;
-			p = verticesDataTable + READ_BE_UINT16(verticesOffsetTable + (verticesOffset & 0x3FFF) * 2);
-			dx = 0;
-			dy = 0;
-			if (verticesOffset & 0x8000) {
-				dx = READ_BE_UINT16(shapeData); shapeData += 2;
-				dy = READ_BE_UINT16(shapeData); shapeData += 2;
-			}
-			_hasAlphaColor = (verticesOffset & 0x4000) != 0;
-			uint8 color = *shapeData++;
+	const CutsceneShape *shape = getShape(shapeOffset & 0x7FF);
+	if (shape->primitivesCount != 0) {
+		const CutscenePrimitive *prim = &shape->primitives[0];
+		_shape_ox = prim->vertices[0] + prim->dx;
+		_shape_oy = prim->vertices[1] + prim->dy;
+		for (int i = 0; i < shape->primitivesCount; ++i) {
+			prim = &shape->primitives[i];
+			_hasAlphaColor = prim->hasAlphaColor;
+			uint8 color = prim->color;
 			if (_clearScreen == 0) {
 				color += 0x10; // 2nd pal buf
 			}
 			_primitiveColor = 0xC0 + color;
-			drawShapeScale(p, zoom, dx, dy, x, y, 0, 0);
+			drawShapeScale(prim, zoom, prim->dx, prim->dy, x, y, 0, 0);
 			++_shape_count;
 		}
+		addShapesDirtyRect();
 	}
+	_rasterTimeUs += _stub->getTimeStampUs() - rasterStart;
 }
 
-void Cutscene::drawShapeScaleRotate(const uint8 *data, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g) {
+void Cutscene::drawShapeScaleRotate(const CutscenePrimitive *prim, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g) {
 	debug(DBG_CUT, "Cutscene::drawShapeScaleRotate(%d, %d, %d, %d, %d, %d, %d)", zoom, b, c, d, e, f, g);
 	_gfx._layer = _page1;
-	uint8 numVertices = *data++;
-	if (numVertices & 0x80) {
-		int16 x, y, ix, iy;
+	const int16 *v = prim->vertices;
+	if (prim->type == CutscenePrimitive::TYPE_ELLIPSE) {
+		int16 x, y;
 		Point pr[2];
 		Point *pt = _vertices;
-		_shape_cur_x = ix = b + READ_BE_UINT16(data); data += 2;
-		_shape_cur_y = iy = c + READ_BE_UINT16(data); data += 2;
-		x = READ_BE_UINT16(data); data += 2;
-		y = READ_BE_UINT16(data); data += 2;
-		_shape_cur_x16 = _shape_ix - ix;
-		_shape_cur_y16 = _shape_iy - iy;
-		_shape_ox = _shape_cur_x = _shape_ix + ((_shape_cur_x16 * _rotData[0] + _shape_cur_y16 * _rotData[1]) >> 8);
-		_shape_oy = _shape_cur_y = _shape_iy + ((_shape_cur_x16 * _rotData[2] + _shape_cur_y16 * _rotData[3]) >> 8);
+		int32 cx, cy;
+		transformVertices(v, 1, b, c, _rotData, _shape_ix, _shape_iy, &cx, &cy);
+		x = v[2];
+		y = v[3];
+		_shape_ox = _shape_cur_x = cx;
+		_shape_oy = _shape_cur_y = cy;
 		pr[0].x =  0;
 		pr[0].y = -y;
 		pr[1].x = -x;
@@ -650,14 +954,12 @@ void Cutscene::drawShapeScaleRotate(const uint8 *data, int16 zoom, int16 b, int1
 		int16 rx = _vertices[0].x - _vertices[2].x;
 		int16 ry = _vertices[0].y - _vertices[1].y;
 		_gfx.drawEllipse(_primitiveColor, _hasAlphaColor, &po, rx, ry);
-	} else if (numVertices == 0) {
+	} else if (prim->type == CutscenePrimitive::TYPE_POINT) {
 		Point pt;
-		pt.x = b + READ_BE_UINT16(data); data += 2;
-		pt.y = c + READ_BE_UINT16(data); data += 2;
-		_shape_cur_x16 = _shape_ix - pt.x;
-		_shape_cur_y16 = _shape_iy - pt.y;
-		_shape_cur_x = _shape_ix + ((_rotData[0] * _shape_cur_x16 + _rotData[1] * _shape_cur_y16) >> 8);
-		_shape_cur_y = _shape_iy + ((_rotData[2] * _shape_cur_x16 + _rotData[3] * _shape_cur_y16) >> 8);
+		int32 cx, cy;
+		transformVertices(v, 1, b, c, _rotData, _shape_ix, _shape_iy, &cx, &cy);
+		_shape_cur_x = cx;
+		_shape_cur_y = cy;
 		if (_shape_count != 0) {
 			_shape_cur_x16 = _shape_prev_x16 + (_shape_cur_x - _shape_prev_x) * zoom * 128;
 			pt.x = ((_shape_cur_x16 + 0x8000) >> 16) + _shape_ix + d;
@@ -677,55 +979,19 @@ void Cutscene::drawShapeScaleRotate(const uint8 *data, int16 zoom, int16 b, int1
 		_shape_prev_y16 = _shape_cur_y16;
 		_gfx.drawPoint(_primitiveColor, &pt);
 	} else {
-		int16 x, y, a, shape_last_x, shape_last_y;
-		Point tempVertices[40];
-		_shape_cur_x = b + READ_BE_UINT16(data); data += 2;
-		x = _shape_cur_x;
-		_shape_cur_y = c + READ_BE_UINT16(data); data += 2;
-		y = _shape_cur_y;
-		_shape_cur_x16 = _shape_ix - x;
-		_shape_cur_y16 = _shape_iy - y;
-
-		a = _shape_ix + ((_rotData[0] * _shape_cur_x16 + _rotData[1] * _shape_cur_y16) >> 8);
-		if (_shape_count == 0) {
-			_shape_ox = a;
-		}
-		_shape_cur_x = shape_last_x = a;
-		a = _shape_iy + ((_rotData[2] * _shape_cur_x16 + _rotData[3] * _shape_cur_y16) >> 8);
+		int32 xs[0x80], ys[0x80];
+		transformVertices(v, prim->numVertices, b, c, _rotData, _shape_ix, _shape_iy, xs, ys);
 		if (_shape_count == 0) {
-			_shape_oy = a;
-		}
-		_shape_cur_y = shape_last_y = a;
-
-		int16 ix = x;
-		int16 iy = y;
-		Point *pt2 = tempVertices;
-		int16 sx = 0;
-		for (int16 n = numVertices - 1; n >= 0; --n) {
-			x = (int8)(*data++) + sx;
-			y = (int8)(*data++);
-			if (y == 0 && n != 0 && *(data + 1) == 0) {
-				sx = x;
-				--numVertices;
-			} else {
-				ix += x;
-				iy += y;
-				sx = 0;
-				_shape_cur_x16 = _shape_ix - ix;
-				_shape_cur_y16 = _shape_iy - iy;
-				a = _shape_ix + ((_rotData[0] * _shape_cur_x16 + _rotData[1] * _shape_cur_y16) >> 8);
-				pt2->x = a - shape_last_x;
-				shape_last_x = a;
-				a = _shape_iy + ((_rotData[2] * _shape_cur_x16 + _rotData[3] * _shape_cur_y16) >> 8);
-				pt2->y = a - shape_last_y;
-				shape_last_y = a;
-				++pt2;
-			}
+			_shape_ox = xs[0];
+			_shape_oy = ys[0];
 		}
+		_shape_cur_x = xs[0];
+		_shape_cur_y = ys[0];
+
 		Point *pt = _vertices;
 		if (_shape_count == 0) {
-			ix = _shape_ox;
-			iy = _shape_oy;
+			int16 ix = _shape_ox;
+			int16 iy = _shape_oy;
 			f -= (((_shape_ix - ix) * zoom * 128) + 0x8000) >> 16;
 			g -= (((_shape_iy - iy) * zoom * 128) + 0x8000) >> 16;
 			pt->x = f + _shape_ix + d;
@@ -740,81 +1006,46 @@ void Cutscene::drawShapeScaleRotate(const uint8 *data, int16 zoom, int16 b, int1
 			pt->y = _shape_iy + e + ((_shape_cur_y16 + 0x8000) >> 16);
 			++pt;
 		}
-		for (int i = 0; i < numVertices; ++i) {
-			_shape_cur_x += tempVertices[i].x;
-			_shape_cur_x16 += tempVertices[i].x * zoom * 128;
-			pt->x = d + _shape_ix + ((_shape_cur_x16 + 0x8000) >> 16);
-			_shape_cur_y += tempVertices[i].y;
-			_shape_cur_y16 += tempVertices[i].y * zoom * 128;
-			pt->y = e + _shape_iy + ((_shape_cur_y16 + 0x8000) >> 16);
-			++pt;
-		}
+		scaleVertices(xs, ys, prim->numVertices, zoom, &_shape_cur_x16, &_shape_cur_y16, _shape_ix + d, _shape_iy + e, pt);
+		_shape_cur_x = xs[prim->numVertices - 1];
+		_shape_cur_y = ys[prim->numVertices - 1];
 		_shape_prev_x = _shape_cur_x;
 		_shape_prev_y = _shape_cur_y;
 		_shape_prev_x16 = _shape_cur_x16;
 		_shape_prev_y16 = _shape_cur_y16;
-		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, numVertices + 1);
+		_gfx.drawPolygon(_primitiveColor, _hasAlphaColor, _vertices, prim->numVertices);
 	}
 }
 
 void Cutscene::op_drawShapeScaleRotate() {
 	debug(DBG_CUT, "Cutscene::op_drawShapeScaleRotate()");
+	const uint32 rasterStart = _stub->getTimeStampUs();
 
 	_shape_count = 0;
 
-	int16 x = 0;
-	int16 y = 0;
-	uint16 shapeOffset = fetchNextCmdWord();
-	if (shapeOffset & 0x8000) {
-		x = fetchNextCmdWord();
-		y = fetchNextCmdWord();
-	}
-
-	uint16 zoom = 512;
-	if (shapeOffset & 0x4000) {
-		zoom += fetchNextCmdWord();
-	}
-	_shape_ix = fetchNextCmdByte();
-	_shape_iy = fetchNextCmdByte();
-
-	uint16 r1, r2, r3;
-	r1 = fetchNextCmdWord();
-	r2 = 180;
-	if (shapeOffset & 0x2000) {
-		r2 = fetchNextCmdWord();
-	}
-	r3 = 90;
-	if (shapeOffset & 0x1000) {
-		r3 = fetchNextCmdWord();
-	}
-	initRotationData(r1, r2, r3);
-
-	const uint8 *shapeOffsetTable    = _polPtr + READ_BE_UINT16(_polPtr + 0x02);
-	const uint8 *shapeDataTable      = _polPtr + READ_BE_UINT16(_polPtr + 0x0E);
-	const uint8 *verticesOffsetTable = _polPtr + READ_BE_UINT16(_polPtr + 0x0A);
-	const uint8 *verticesDataTable   = _polPtr + READ_BE_UINT16(_polPtr + 0x12);
+	const int16 *args = _cmdInsn->args;
+	uint16 shapeOffset = args[0];
+	int16 x = args[1];
+	int16 y = args[2];
+	uint16 zoom = args[3] + 512;
+	_shape_ix = args[4];
+	_shape_iy = args[5];
+	initRotationData(args[6], args[7], args[8]);
 
-	const uint8 *shapeData = shapeDataTable + READ_BE_UINT16(shapeOffsetTable + (shapeOffset & 0x7FF) * 2);
-	uint16 primitiveCount = READ_BE_UINT16(shapeData); shapeData += 2;
-
-	while (primitiveCount--) {
-		uint16 verticesOffset = READ_BE_UINT16(shapeData); shapeData += 2;
-		const uint8 *p = verticesDataTable + READ_BE_UINT16(verticesOffsetTable + (verticesOffset & 0x3FFF) * 2);
-		int16 dx = 0;
-		int16 dy = 0;
-		if (verticesOffset & 0x8000) {
-			dx = READ_BE_UINT16(shapeData); shapeData += 2;
-			dy = READ_BE_UINT16(shapeData); shapeData += 2;
-		}
-		_hasAlphaColor = (verticesOffset & 0x4000) != 0;
-		uint8 color = *shapeData++;
+	const CutsceneShape *shape = getShape(shapeOffset & 0x7FF);
+	for (int i = 0; i < shape->primitivesCount; ++i) {
+		const CutscenePrimitive *prim = &shape->primitives[i];
+		_hasAlphaColor = prim->hasAlphaColor;
+		uint8 color = prim->color;
 		if (_clearScreen == 0) {
 			color += 0x10; // 2nd pal buf
 		}
 		_primitiveColor = 0xC0 + color;
-		drawShapeScaleRotate(p, zoom, dx, dy, x, y, 0, 0);
+		drawShapeScaleRotate(prim, zoom, prim->dx, prim->dy, x, y, 0, 0);
 		++_shape_count;
 	}
+	addShapesDirtyRect();
+	_rasterTimeUs += _stub->getTimeStampUs() - rasterStart;
 }
 
 void Cutscene::op_drawCreditsText() {
@@ -823,17 +1054,17 @@ void Cutscene::op_drawCreditsText() {
 	if (_textCurBuf == _textBuf) {
 		++_creditsTextCounter;
 	}
-	memcpy(_page1, _page0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+	copyPage(_page1, _page0);
 	_frameDelay = 10;
 	setPalette();
 }
 
 void Cutscene::op_drawStringAtPos() {
 	debug(DBG_CUT, "Cutscene::op_drawStringAtPos()");
-	uint16 strId = fetchNextCmdWord();
+	uint16 strId = _cmdInsn->args[0];
 	if (strId != 0xFFFF) {
-		int16 x = (int8)fetchNextCmdByte() * 8;
-		int16 y = (int8)fetchNextCmdByte() * 8;
+		int16 x = (int8)_cmdInsn->args[1] * 8;
+		int16 y = (int8)_cmdInsn->args[2] * 8;
 		if (!_creditsSequence) {
 			const uint8 *str = _res->getCineString(strId & 0xFFF);
 			if (str) {
@@ -842,9 +1073,25 @@ void Cutscene::op_drawStringAtPos() {
 			}
 			// workaround for buggy cutscene script
 			if (_id == 0x34 && (strId & 0xFFF) == 0x45) {
-				if ((_cmdPtr - _cmdPtrBak) == 0xA) {
+				if (_workerActive) {
+					Frame *f = acquireFrame();
+					if (f) {
+						if (_cmdInsn->offset + _cmdInsn->size - _cmdInsns[_cmdMark].offset == 0xA) {
+							// _page1 is still being drawn, present a copy of it
+							uint8 *page = getFreePage();
+							copyPage(page, _page1);
+							f->flags = FRAME_PAGE;
+							f->page = page;
+						} else {
+							f->flags = FRAME_SLEEP;
+							f->delay = 15;
+						}
+						commitFrame();
+					}
+				} else if (_cmdInsn->offset + _cmdInsn->size - _cmdInsns[_cmdMark].offset == 0xA) {
 					_stub->copyRect(0, 0, Video::GAMESCREEN_W, Video::GAMESCREEN_H, _page1, 256);
 					_stub->updateScreen(0);
+					_vid->digestLayer(_page1);
 				} else {
 					_stub->sleep(15);
 				}
@@ -855,13 +1102,25 @@ void Cutscene::op_drawStringAtPos() {
 
 void Cutscene::op_handleKeys() {
 	debug(DBG_CUT, "Cutscene::op_handleKeys()");
-	while (1) {
-		uint8 key_mask = fetchNextCmdByte();
-		if (key_mask == 0xFF) {
+	if (_workerActive) {
+		// the input is read once the previous frames have been presented
+		if (waitForBarrier()) {
+			handleKeys();
+			releaseBarrier();
+		}
+	} else {
+		handleKeys();
+	}
+}
+
+void Cutscene::handleKeys() {
+	const CutsceneKeyBranch *branch = &_cmdBranches[_cmdInsn->branches];
+	for (int i = 0; ; ++i, ++branch) {
+		if (i == _cmdInsn->branchesCount) {
 			return;
 		}
 		bool b = true;
-		switch (key_mask) {
+		switch (branch->keyMask) {
 		case 1:
 			b = (_stub->_pi.dirMask & PlayerInput::DIR_UP) != 0;
 			break;
@@ -881,44 +1140,583 @@ void Cutscene::op_handleKeys() {
 		if (b) {
 			break;
 		}
-		_cmdPtr += 2;
 	}
 	_stub->_pi.dirMask = 0;
 	_stub->_pi.enter = false;
 	_stub->_pi.space = false;
 	_stub->_pi.shift = false;
-	int16 n = fetchNextCmdWord();
-	if (n < 0) {
-		n = -n - 1;
-		if (_varKey == 0) {
-			_stop = true;
-			return;
+	int16 n = branch->target;
+	if (n >= 0) {
+		_cmdPc = _cmdMark = branch->insn;
+		return;
+	}
+	n = -n - 1;
+	if (_varKey == 0) {
+		_stop = true;
+		return;
+	}
+	if (_varKey != n) {
+		_cmdPc = _cmdMark;
+		return;
+	}
+	_varKey = 0;
+	--n;
+	if ((n + 2) * 2 > _cmdLen) {
+		warning("Invalid cutscene script entry %d", n);
+		_stop = true;
+		return;
+	}
+	n = READ_BE_UINT16(_cmdData + n * 2 + 2);
+	_cmdPc = _cmdMark = getInstruction(_startOffset + (uint16)n);
+}
+
+struct CmdReader {
+	const uint8 *_data;
+	uint32 _len, _pos;
+
+	bool fetchByte(int16 *b) {
+		if (_pos + 1 > _len) {
+			return false;
 		}
-		if (_varKey != n) {
-			_cmdPtr = _cmdPtrBak;
-			return;
+		*b = _data[_pos];
+		_pos += 1;
+		return true;
+	}
+	bool fetchWord(int16 *w) {
+		if (_pos + 2 > _len) {
+			return false;
+		}
+		*w = READ_BE_UINT16(_data + _pos);
+		_pos += 2;
+		return true;
+	}
+};
+
+// Decodes the opcode and operands at offset, the optional operands are set to
+// their default values. Returns false if the script data ends before them.
+bool Cutscene::decodeInstruction(uint32 offset, CutsceneInstruction *insn) {
+	memset(insn, 0, sizeof(CutsceneInstruction));
+	insn->offset = offset;
+	insn->next = NO_INSTRUCTION;
+	CmdReader r;
+	r._data = _cmdData;
+	r._len = _cmdLen;
+	r._pos = offset;
+	int16 *args = insn->args;
+	int16 op;
+	bool ok = r.fetchByte(&op);
+	if (!ok || (op & 0x80) != 0) {
+		insn->opcode = OPCODE_END;
+		return ok;
+	}
+	insn->opcode = op >> 2;
+	switch (insn->opcode) {
+	case 1: // op_refreshScreen: clear flag
+	case 2: // op_waitForSync: delay
+		ok = r.fetchByte(&args[0]);
+		break;
+	case 3: // op_drawShape: shape, x, y
+		ok = r.fetchWord(&args[0]);
+		if (ok && (args[0] & 0x8000) != 0) {
+			ok = r.fetchWord(&args[1]) && r.fetchWord(&args[2]);
+		}
+		break;
+	case 4: // op_setPalette: palette, slot
+		ok = r.fetchByte(&args[0]) && r.fetchByte(&args[1]);
+		break;
+	case 6: // op_drawStringAtBottom: string
+		ok = r.fetchWord(&args[0]);
+		break;
+	case 8: // op_skip3
+		r._pos += 3;
+		ok = (r._pos <= r._len);
+		break;
+	case 9: // op_refreshAll
+	case 14: // op_handleKeys: key mask and target pairs, terminated with 0xFF
+		insn->branches = _cmdBranchesCount;
+		while (1) {
+			int16 keyMask;
+			ok = r.fetchByte(&keyMask);
+			if (!ok || keyMask == 0xFF) {
+				break;
+			}
+			CutsceneKeyBranch branch;
+			branch.keyMask = keyMask;
+			branch.insn = NO_INSTRUCTION;
+			ok = r.fetchWord(&branch.target);
+			if (!ok) {
+				break;
+			}
+			if (_cmdBranchesCount == _cmdBranchesSize) {
+				_cmdBranchesSize *= 2;
+				CutsceneKeyBranch *branches = (CutsceneKeyBranch *)_cmdArena.allocate(_cmdBranchesSize * sizeof(CutsceneKeyBranch));
+				memcpy(branches, _cmdBranches, _cmdBranchesCount * sizeof(CutsceneKeyBranch));
+				_cmdBranches = branches;
+			}
+			_cmdBranches[_cmdBranchesCount++] = branch;
+			++insn->branchesCount;
+		}
+		break;
+	case 10: // op_drawShapeScale: shape, x, y, zoom, ix, iy
+		ok = r.fetchWord(&args[0]);
+		if (ok && (args[0] & 0x8000) != 0) {
+			ok = r.fetchWord(&args[1]) && r.fetchWord(&args[2]);
+		}
+		ok = ok && r.fetchWord(&args[3]) && r.fetchByte(&args[4]) && r.fetchByte(&args[5]);
+		break;
+	case 11: // op_drawShapeScaleRotate: shape, x, y, zoom, ix, iy, 3 angles
+		ok = r.fetchWord(&args[0]);
+		if (ok && (args[0] & 0x8000) != 0) {
+			ok = r.fetchWord(&args[1]) && r.fetchWord(&args[2]);
+		}
+		if (ok && (args[0] & 0x4000) != 0) {
+			ok = r.fetchWord(&args[3]);
+		}
+		ok = ok && r.fetchByte(&args[4]) && r.fetchByte(&args[5]) && r.fetchWord(&args[6]);
+		args[7] = 180;
+		if (ok && (args[0] & 0x2000) != 0) {
+			ok = r.fetchWord(&args[7]);
+		}
+		args[8] = 90;
+		if (ok && (args[0] & 0x1000) != 0) {
+			ok = r.fetchWord(&args[8]);
+		}
+		break;
+	case 13: // op_drawStringAtPos: string, x, y
+		ok = r.fetchWord(&args[0]);
+		if (ok && args[0] != -1) {
+			ok = r.fetchByte(&args[1]) && r.fetchByte(&args[2]);
+		}
+		break;
+	}
+	insn->size = r._pos - offset;
+	return ok;
+}
+
+// Decodes the instructions from offset until the end of the script or an
+// instruction decoded before. Returns the index of the first one.
+uint16 Cutscene::decodeInstructions(uint32 offset) {
+	uint16 first = NO_INSTRUCTION;
+	int prev = -1;
+	while (1) {
+		uint16 num = 0; // end of script
+		bool decoded = false;
+		if (offset < (uint32)_cmdLen && _cmdOffsets[offset] != NO_INSTRUCTION) {
+			num = _cmdOffsets[offset];
+		} else if (offset < (uint32)_cmdLen) {
+			CutsceneInstruction insn;
+			if (!decodeInstruction(offset, &insn)) {
+				warning("Truncated cutscene script instruction at 0x%X", offset);
+			} else if (insn.opcode != OPCODE_END) {
+				if (_cmdInsnsCount == _cmdInsnsSize) {
+					if (_cmdInsnsSize * 2 > NO_INSTRUCTION) {
+						error("Too many cutscene script instructions");
+					}
+					_cmdInsnsSize *= 2;
+					CutsceneInstruction *insns = (CutsceneInstruction *)_cmdArena.allocate(_cmdInsnsSize * sizeof(CutsceneInstruction));
+					memcpy(insns, _cmdInsns, _cmdInsnsCount * sizeof(CutsceneInstruction));
+					_cmdInsns = insns;
+				}
+				num = _cmdInsnsCount++;
+				_cmdInsns[num] = insn;
+				decoded = true;
+			}
+			_cmdOffsets[offset] = num;
+		}
+		if (prev < 0) {
+			first = num;
+		} else {
+			_cmdInsns[prev].next = num;
 		}
-		_varKey = 0;
-		--n;
-		_cmdPtr = _res->_cmd;
-		n = READ_BE_UINT16(_cmdPtr + n * 2 + 2);
+		if (!decoded) {
+			break;
+		}
+		if (_cmdInsns[num].opcode >= NUM_OPCODES) {
+			// invalid, error when executed
+			_cmdInsns[num].next = 0;
+			break;
+		}
+		prev = num;
+		offset += _cmdInsns[num].size;
 	}
-	_cmdPtr = _cmdPtrBak = _res->_cmd + n + _startOffset;
+	return first;
 }
 
-uint8 Cutscene::fetchNextCmdByte() {
-	return *_cmdPtr++;
+uint16 Cutscene::getInstruction(uint32 offset) {
+	const int branchesCount = _cmdBranchesCount;
+	const uint16 num = decodeInstructions(offset);
+	// the key branches of the new instructions, the array grows as they are decoded
+	for (int i = branchesCount; i < _cmdBranchesCount; ++i) {
+		if (_cmdBranches[i].target >= 0) {
+			const uint16 target = decodeInstructions(_startOffset + _cmdBranches[i].target);
+			_cmdBranches[i].insn = target;
+		}
+	}
+	return num;
 }
 
-uint16 Cutscene::fetchNextCmdWord() {
-	uint16 i = READ_BE_UINT16(_cmdPtr);
-	_cmdPtr += 2;
-	return i;
+void Cutscene::compileCmd(const uint8 *cmdData, int cmdLen) {
+	_cmdArena.reset();
+	_cmdData = cmdData;
+	_cmdLen = cmdLen;
+	_cmdOffsets = (uint16 *)_cmdArena.allocate(cmdLen * sizeof(uint16));
+	memset(_cmdOffsets, 0xFF, cmdLen * sizeof(uint16));
+	_cmdInsnsSize = 256;
+	_cmdInsns = (CutsceneInstruction *)_cmdArena.allocate(_cmdInsnsSize * sizeof(CutsceneInstruction));
+	_cmdBranchesSize = 64;
+	_cmdBranches = (CutsceneKeyBranch *)_cmdArena.allocate(_cmdBranchesSize * sizeof(CutsceneKeyBranch));
+	_cmdBranchesCount = 0;
+	// the first instruction ends the script
+	_cmdInsnsCount = 1;
+	memset(&_cmdInsns[0], 0, sizeof(CutsceneInstruction));
+	_cmdInsns[0].opcode = OPCODE_END;
+	_cmdInsns[0].offset = cmdLen;
+	_startOffset = 0;
+	if (cmdLen < 2) {
+		return;
+	}
+	const int count = READ_BE_UINT16(cmdData);
+	_startOffset = (count + 1) * 2;
+	getInstruction(_startOffset);
+	for (int i = 0; i < count && (i + 2) * 2 <= cmdLen; ++i) {
+		getInstruction(_startOffset + READ_BE_UINT16(cmdData + (i + 1) * 2));
+	}
+	debug(DBG_CUT, "Cutscene::compileCmd() %d instructions, %d bytes", _cmdInsnsCount, _cmdArena._allocatedSize);
+}
+
+bool Cutscene::executeOpcode() {
+	const CutsceneInstruction *insn = &_cmdInsns[_cmdPc];
+	debug(DBG_CUT, "Cutscene::play() opcode = 0x%X offset = 0x%X", insn->opcode, insn->offset);
+	_cmdInsn = insn;
+	_cmdPc = insn->next;
+	switch (insn->opcode) {
+	case 0:
+	case 5:
+		op_markCurPos();
+		break;
+	case 1:
+		op_refreshScreen();
+		break;
+	case 2:
+		op_waitForSync();
+		break;
+	case 3:
+		op_drawShape();
+		break;
+	case 4:
+		op_setPalette();
+		break;
+	case 6:
+		op_drawStringAtBottom();
+		break;
+	case 7:
+		op_nop();
+		break;
+	case 8:
+		op_skip3();
+		break;
+	case 9:
+		op_refreshAll();
+		break;
+	case 10:
+		op_drawShapeScale();
+		break;
+	case 11:
+		op_drawShapeScaleRotate();
+		break;
+	case 12:
+		op_drawCreditsText();
+		break;
+	case 13:
+		op_drawStringAtPos();
+		break;
+	case 14:
+		op_handleKeys();
+		break;
+	case OPCODE_END:
+		return false;
+	default:
+		error("Invalid cutscene opcode = 0x%02X", insn->opcode);
+		return false;
+	}
+	++_opcodeCounts[insn->opcode];
+	return true;
+}
+
+// Moves the content and the state of _page0 and _page1 to other buffers.
+void Cutscene::movePages(uint8 *page0, uint8 *page1) {
+	PageState s0 = *getPageState(_page0);
+	PageState s1 = *getPageState(_page1);
+	memcpy(page0, _page0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+	memcpy(page1, _page1, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+	s0.page = _page0 = page0;
+	s1.page = _page1 = page1;
+	_pageStates[0] = s0;
+	_pageStates[1] = s1;
+}
+
+// Returns a page of _framesPages which is neither _page0, _page1 nor queued.
+uint8 *Cutscene::getFreePage() {
+	MutexStack ms(_stub, _framesMutex);
+	for (int i = 0; i < NUM_PAGES; ++i) {
+		uint8 *page = _framesPages + i * Video::GAMESCREEN_W * Video::GAMESCREEN_H;
+		if (page == _page0 || page == _page1) {
+			continue;
+		}
+		uint32 j = _framesTail;
+		for (; j != _framesHead; ++j) {
+			const Frame *f = &_frames[j % NUM_FRAMES];
+			if ((f->flags & FRAME_PAGE) && f->page == page) {
+				break;
+			}
+		}
+		if (j == _framesHead) {
+			return page;
+		}
+	}
+	error("No free cutscene page");
+	return 0;
+}
+
+// _page0 may be queued, it is replaced by a copy before being drawn to.
+void Cutscene::detachPage0() {
+	uint8 *page = getFreePage();
+	copyPage(page, _page0);
+	_page0 = page;
+}
+
+bool Cutscene::startWorker() {
+	_framesPages = (uint8 *)malloc(NUM_PAGES * Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+	_framesMutex = _stub->createMutex();
+	_workerEvent = _stub->createEvent();
+	_presentEvent = _stub->createEvent();
+	if (_framesPages && _framesMutex && _workerEvent && _presentEvent) {
+		movePages(_framesPages, _framesPages + Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		for (int i = 2; i < NUM_PAGES; ++i) {
+			resetPageState(&_pageStates[i], _framesPages + i * Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		}
+		_pagesCount = NUM_PAGES;
+		_framesHead = _framesTail = 0;
+		_workerDone = false;
+		_workerStopRequested = false;
+		_barrierReached = false;
+		_presentNewPal = false;
+		_workerActive = true;
+		_worker = _stub->createThread(workerThread, this);
+		if (_worker) {
+			return true;
+		}
+		_workerActive = false;
+	}
+	warning("Unable to start the cutscene thread, rendering synchronously");
+	stopWorker();
+	return false;
+}
+
+void Cutscene::stopWorker() {
+	if (_worker) {
+		_stub->lockMutex(_framesMutex);
+		_workerStopRequested = true;
+		_stub->unlockMutex(_framesMutex);
+		_stub->signalEvent(_workerEvent);
+		_stub->joinThread(_worker);
+		_worker = 0;
+	}
+	_workerActive = false;
+	if (_pagesCount != 2) {
+		// back to the video layers set by prepare()
+		movePages(_vid->_frontLayer, _vid->_tempLayer);
+		_pagesCount = 2;
+	}
+	if (_framesMutex) {
+		_stub->destroyMutex(_framesMutex);
+		_framesMutex = 0;
+	}
+	if (_workerEvent) {
+		_stub->destroyEvent(_workerEvent);
+		_workerEvent = 0;
+	}
+	if (_presentEvent) {
+		_stub->destroyEvent(_presentEvent);
+		_presentEvent = 0;
+	}
+	free(_framesPages);
+	_framesPages = 0;
+}
+
+bool Cutscene::isWorkerStopRequested() {
+	MutexStack ms(_stub, _framesMutex);
+	return _workerStopRequested;
+}
+
+// Returns the next free frame of the ring, waiting for the main thread to
+// present one if they are all queued. Returns null when the worker is asked
+// to stop.
+Cutscene::Frame *Cutscene::acquireFrame() {
+	while (1) {
+		_stub->lockMutex(_framesMutex);
+		const bool full = (_framesHead - _framesTail == NUM_FRAMES);
+		const bool stop = _workerStopRequested;
+		_stub->unlockMutex(_framesMutex);
+		if (stop) {
+			return 0;
+		}
+		if (!full) {
+			return &_frames[_framesHead % NUM_FRAMES];
+		}
+		_stub->waitEvent(_workerEvent);
+	}
+}
+
+void Cutscene::commitFrame() {
+	_stub->lockMutex(_framesMutex);
+	++_framesHead;
+	_stub->unlockMutex(_framesMutex);
+	_stub->signalEvent(_presentEvent);
+}
+
+// Queues a barrier and waits for the main thread to reach it. The main
+// thread then leaves the player input alone until releaseBarrier().
+bool Cutscene::waitForBarrier() {
+	Frame *f = acquireFrame();
+	if (!f) {
+		return false;
+	}
+	f->flags = FRAME_BARRIER;
+	commitFrame();
+	while (1) {
+		_stub->lockMutex(_framesMutex);
+		const bool reached = _barrierReached;
+		const bool stop = _workerStopRequested;
+		_stub->unlockMutex(_framesMutex);
+		if (reached) {
+			return true;
+		}
+		if (stop) {
+			return false;
+		}
+		_stub->waitEvent(_workerEvent);
+	}
+}
+
+void Cutscene::releaseBarrier() {
+	_stub->lockMutex(_framesMutex);
+	_barrierReached = false;
+	_stub->unlockMutex(_framesMutex);
+	_stub->signalEvent(_presentEvent);
+}
+
+void Cutscene::workerThread(void *param) {
+	Cutscene *c = (Cutscene *)param;
+	while (!c->_stop && !c->isWorkerStopRequested()) {
+		if (!c->executeOpcode()) {
+			break;
+		}
+	}
+	c->_stub->lockMutex(c->_framesMutex);
+	c->_workerDone = true;
+	c->_stub->unlockMutex(c->_framesMutex);
+	c->_stub->signalEvent(c->_presentEvent);
+}
+
+// Waits until timeStamp, still handling the events if that is far enough.
+void Cutscene::waitUntil(uint32 timeStamp) {
+	while (!_stub->_pi.quit && !_interrupted) {
+		const int32 pause = timeStamp - _stub->getTimeStamp();
+		if (pause <= 0) {
+			break;
+		}
+		if (pause > 20) {
+			_stub->processEvents();
+			if (_stub->_pi.backspace) {
+				_stub->_pi.backspace = false;
+				_interrupted = true;
+			}
+		} else {
+			_stub->sleep(pause);
+		}
+	}
+}
+
+void Cutscene::presentFrame(const Frame *f) {
+	bool skip = false;
+	if (f->flags & FRAME_SYNC) {
+		if (!(_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE)) {
+			const uint32 pause = _frameSched->scheduleFrame(f->delay * 1000) / 1000;
+			waitUntil(_stub->getTimeStamp() + pause);
+			skip = _frameSched->_skipFrame;
+		} else {
+			_frameSched->reset();
+		}
+	}
+	if (f->flags & FRAME_SLEEP) {
+		waitUntil(_stub->getTimeStamp() + f->delay);
+	}
+	if (f->flags & FRAME_PALETTE) {
+		memcpy(_presentPalBuf, f->palBuf, sizeof(_presentPalBuf));
+		_presentNewPal = true;
+	}
+	if ((f->flags & FRAME_PAGE) && !skip) {
+		if (_presentNewPal) {
+			applyPalette(_presentPalBuf);
+			_presentNewPal = false;
+		}
+		_stub->copyRect(0, 0, Video::GAMESCREEN_W, Video::GAMESCREEN_H, f->page, 256);
+		_stub->updateScreen(0);
+		_vid->digestLayer(f->page);
+	}
+}
+
+// Presents the frames queued by the worker thread until it runs out of
+// opcodes, or asks it to stop on interruption.
+void Cutscene::presentFrames() {
+	while (1) {
+		_stub->lockMutex(_framesMutex);
+		const bool empty = (_framesHead == _framesTail);
+		const bool done = _workerDone;
+		_stub->unlockMutex(_framesMutex);
+		if (!empty) {
+			const Frame *f = &_frames[_framesTail % NUM_FRAMES];
+			if (f->flags & FRAME_BARRIER) {
+				_stub->lockMutex(_framesMutex);
+				_barrierReached = true;
+				_stub->unlockMutex(_framesMutex);
+				_stub->signalEvent(_workerEvent);
+				while (1) {
+					_stub->lockMutex(_framesMutex);
+					const bool reached = _barrierReached;
+					_stub->unlockMutex(_framesMutex);
+					if (!reached) {
+						break;
+					}
+					_stub->waitEvent(_presentEvent);
+				}
+			} else {
+				presentFrame(f);
+			}
+			_stub->lockMutex(_framesMutex);
+			++_framesTail;
+			_stub->unlockMutex(_framesMutex);
+			_stub->signalEvent(_workerEvent);
+		} else if (done) {
+			break;
+		} else {
+			_stub->waitEvent(_presentEvent);
+		}
+		_stub->processEvents();
+		if (_stub->_pi.backspace) {
+			_stub->_pi.backspace = false;
+			_interrupted = true;
+		}
+		if (_stub->_pi.quit || _interrupted) {
+			break;
+		}
+	}
 }
 
 void Cutscene::mainLoop(uint16 offset) {
 	_frameDelay = 5;
-	_tstamp = _stub->getTimeStamp();
+	_frameSched->reset();
 
 	Color c;
 	c.r = c.g = c.b = 0;
@@ -934,29 +1732,33 @@ void Cutscene::mainLoop(uint16 offset) {
 	if (offset != 0) {
 		offset = READ_BE_UINT16(p + (offset + 1) * 2);
 	}
-	_startOffset = (READ_BE_UINT16(p) + 1) * 2;
 	_varKey = 0;
-	_cmdPtr = _cmdPtrBak = p + _startOffset + offset;
+	_cmdPc = _cmdMark = getInstruction(_startOffset + offset);
+	memset(_opcodeCounts, 0, sizeof(_opcodeCounts));
 	_polPtr = _res->_pol;
 	debug(DBG_CUT, "_startOffset = %d offset = %d", _startOffset, offset);
 
-	while (!_stub->_pi.quit && !_interrupted && !_stop) {
-		uint8 op = fetchNextCmdByte();
-		debug(DBG_CUT, "Cutscene::play() opcode = 0x%X (%d)", op, (op >> 2));
-		if (op & 0x80) {
-			break;
-		}
-		op >>= 2;
-		if (op >= NUM_OPCODES) {
-			error("Invalid cutscene opcode = 0x%02X", op);
+	if (_renderAhead && startWorker()) {
+		presentFrames();
+		stopWorker();
+	} else {
+		while (!_stub->_pi.quit && !_interrupted && !_stop) {
+			if (!executeOpcode()) {
+				break;
+			}
+			_stub->processEvents();
+			if (_stub->_pi.backspace) {
+				_stub->_pi.backspace = false;
+				_interrupted = true;
+			}
 		}
-		(this->*_opcodeTable[op])();
-		_stub->processEvents();
-		if (_stub->_pi.backspace) {
-			_stub->_pi.backspace = false;
-			_interrupted = true;
+	}
+	for (int i = 0; i < NUM_OPCODES; ++i) {
+		if (_opcodeCounts[i] != 0) {
+			debug(DBG_CUT, "Cutscene::mainLoop() opcode %d executed %d times", i, _opcodeCounts[i]);
 		}
 	}
+	_frameSched->dumpStats("Cutscene");
 	if (_interrupted || _id != 0x0D) {
 		_ply->stop();
 	}
@@ -978,6 +1780,9 @@ void Cutscene::load(uint16 cutName) {
 		_res->load_CINE();
 		break;
 	}
+	// the only place the data is compiled, mainLoop always follows a load
+	compileCmd(_res->_cmd, _res->_cmdLen);
+	compileShapes(_res->_pol, _res->_polLen);
 }
 
 void Cutscene::prepare() {
@@ -991,6 +1796,7 @@ void Cutscene::prepare() {
 	_interrupted = false;
 	_stop = false;
 	_gfx.setClippingRect(8, 50, 240, 128);
+	resetPageStates();
 }
 
 void Cutscene::startCredits() {
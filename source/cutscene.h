@@ -19,22 +19,95 @@
 #define CUTSCENE_H__
 
 #include "intern.h"
+#include "arena.h"
 #include "graphics.h"
 
+struct FrameScheduler;
 struct ModPlayer;
 struct Resource;
 struct SystemStub;
 struct Video;
 
-struct Cutscene {
-	typedef void (Cutscene::*OpcodeStub)();
+struct CutscenePrimitive {
+	enum {
+		TYPE_POLYGON,
+		TYPE_ELLIPSE,
+		TYPE_POINT
+	};
+
+	uint8 type;
+	uint8 color;
+	bool hasAlphaColor;
+	uint8 numVertices;
+	int16 dx, dy;
+	const int16 *vertices; // x, y pairs, x, y, rx, ry for an ellipse
+};
+
+// shape of the polygon data with the delta encoded vertices made absolute
+struct CutsceneShape {
+	uint16 primitivesCount;
+	const CutscenePrimitive *primitives;
+};
+
+// key test of op_handleKeys and op_refreshAll
+struct CutsceneKeyBranch {
+	uint8 keyMask;
+	int16 target; // offset from the script start, negative for a _varKey jump
+	uint16 insn;  // instruction at target
+};
+
+// command of the script data with its operands decoded
+struct CutsceneInstruction {
+	uint8 opcode;
+	uint8 branchesCount;
+	uint16 branches; // index of the first key branch
+	uint16 next;     // instruction executed after this one
+	uint16 size;
+	uint32 offset;   // position in the script data
+	int16 args[9];
+};
 
+struct Cutscene {
 	enum {
 		NUM_OPCODES = 15,
-		TIMER_SLICE = 15
+		NUM_CUTSCENES = 0x4C, // entries of _offsetsTable
+		OPCODE_END = 0xFF,
+		NO_INSTRUCTION = 0xFFFF,
+		TIMER_SLICE = 15,
+		MAX_SHAPES = 0x800,
+		NUM_FRAMES = 4,
+		NUM_PAGES = NUM_FRAMES + 2 // the queued frames, _page0 and _page1
+	};
+
+	enum {
+		FRAME_SYNC    = 1 << 0, // wait 'delay' ms from the previous sync
+		FRAME_SLEEP   = 1 << 1, // wait 'delay' ms
+		FRAME_PALETTE = 1 << 2,
+		FRAME_PAGE    = 1 << 3,
+		FRAME_BARRIER = 1 << 4  // the worker waits for the frame to be reached
+	};
+
+	// presentation request queued by the worker thread
+	struct Frame {
+		uint8 flags;
+		uint16 delay;
+		uint8 palBuf[0x20 * 2];
+		const uint8 *page; // one of _framesPages, not modified until presented
+	};
+
+	enum {
+		PAGE_REF_NONE,
+		PAGE_REF_PAGEC, // identical to _pageC outside of the rectangle
+		PAGE_REF_CLEAR  // filled with 0xC0 outside of the rectangle
+	};
+
+	// content of a page buffer, the rectangle is empty when x1 > x2
+	struct PageState {
+		const uint8 *page;
+		uint8 ref;
+		int16 x1, y1, x2, y2;
 	};
 
-	static const OpcodeStub _opcodeTable[];
 	static const char *_namesTable[];
 	static const uint16 _offsetsTable[];
 	static const uint16 _cosTable[];
@@ -49,21 +122,23 @@ struct Cutscene {
 	Resource *_res;
 	SystemStub *_stub;
 	Video *_vid;
+	FrameScheduler *_frameSched;
 
 	uint16 _id;
 	uint16 _deathCutsceneId;
 	bool _interrupted;
 	bool _stop;
 	uint8 *_polPtr;
-	uint8 *_cmdPtr;
-	uint8 *_cmdPtrBak;
-	uint32 _tstamp;
+	uint16 _cmdPc;
+	uint16 _cmdMark; // instruction following the last op_markCurPos
+	const CutsceneInstruction *_cmdInsn;
 	uint8 _frameDelay;
 	bool _newPal;
 	uint8 _palBuf[0x20 * 2];
 	uint16 _startOffset;
 	bool _creditsSequence;
 	uint32 _rotData[4];
+	uint64 _rotDataKey; // angles _rotData was computed for
 	uint8 _primitiveColor;
 	uint8 _clearScreen;
 	Point _vertices[0x80];
@@ -92,22 +167,61 @@ struct Cutscene {
 	uint8 _creditsTextPosY;
 	int16 _creditsTextCounter;
 	uint8 *_page0, *_page1, *_pageC;
+	PageState _pageStates[NUM_PAGES]; // _page0, _page1, then the other pages of _framesPages
+	int _pagesCount;
+	PageState _pageCState;
+	Arena _shapesArena;
+	const uint8 *_shapesPolData;
+	const CutsceneShape **_shapes;
+	Arena _cmdArena;
+	const uint8 *_cmdData;
+	int _cmdLen;
+	uint16 *_cmdOffsets; // instruction starting at each byte of the script data
+	CutsceneInstruction *_cmdInsns;
+	int _cmdInsnsCount, _cmdInsnsSize;
+	CutsceneKeyBranch *_cmdBranches;
+	int _cmdBranchesCount, _cmdBranchesSize;
+	uint32 _opcodeCounts[NUM_OPCODES];
+	uint32 _rasterTimeUs; // drawing the shapes and restoring the pages
+	bool _renderAhead;
+	bool _workerActive;
+	void *_worker;
+	void *_framesMutex;
+	void *_workerEvent, *_presentEvent; // signaled when the worker and the main thread may proceed
+	uint8 *_framesPages; // the pages the worker draws in
+	Frame _frames[NUM_FRAMES];
+	uint32 _framesHead, _framesTail;
+	bool _workerDone;
+	bool _workerStopRequested;
+	bool _barrierReached;
+	bool _presentNewPal;
+	uint8 _presentPalBuf[0x20 * 2]; // palette of the last frame, uploaded with the next presented page
 
-	Cutscene(ModPlayer *player, Resource *res, SystemStub *stub, Video *vid);
+	Cutscene(ModPlayer *player, Resource *res, SystemStub *stub, Video *vid, FrameScheduler *frameSched);
 
 	void sync();
 	void copyPalette(const uint8 *pal, uint16 num);
+	void applyPalette(const uint8 *palBuf);
 	void updatePalette();
 	void setPalette();
 	void initRotationData(uint16 a, uint16 b, uint16 c);
 	uint16 findTextSeparators(const uint8 *p);
 	void drawText(int16 x, int16 y, const uint8 *p, uint16 color, uint8 *page, uint8 n);
+	void resetPageStates();
+	PageState *getPageState(const uint8 *page);
+	void addPageDirtyRect(const uint8 *page, int16 x1, int16 y1, int16 x2, int16 y2);
+	void addShapesDirtyRect();
+	void copyPage(uint8 *dst, const uint8 *src);
+	void clearPage(uint8 *page);
 	void swapLayers();
 	void drawCreditsText();
 	void drawProtectionShape(uint8 shapeNum, int16 zoom);
-	void drawShape(const uint8 *data, int16 x, int16 y);
-	void drawShapeScale(const uint8 *data, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g);
-	void drawShapeScaleRotate(const uint8 *data, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g);
+	void compileShapes(const uint8 *polData, int polLen);
+	const CutsceneShape *compileShape(const uint8 *polData, int polLen, uint16 num);
+	const CutsceneShape *getShape(uint16 num);
+	void drawShape(const CutscenePrimitive *prim, int16 x, int16 y);
+	void drawShapeScale(const CutscenePrimitive *prim, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g);
+	void drawShapeScaleRotate(const CutscenePrimitive *prim, int16 zoom, int16 b, int16 c, int16 d, int16 e, int16 f, int16 g);
 
 	void op_markCurPos();
 	void op_refreshScreen();
@@ -123,9 +237,27 @@ struct Cutscene {
 	void op_drawCreditsText();
 	void op_drawStringAtPos();
 	void op_handleKeys();
+	void handleKeys();
 
-	uint8 fetchNextCmdByte();
-	uint16 fetchNextCmdWord();
+	void compileCmd(const uint8 *cmdData, int cmdLen);
+	bool decodeInstruction(uint32 offset, CutsceneInstruction *insn);
+	uint16 decodeInstructions(uint32 offset);
+	uint16 getInstruction(uint32 offset);
+	bool executeOpcode();
+	void movePages(uint8 *page0, uint8 *page1);
+	uint8 *getFreePage();
+	void detachPage0();
+	bool startWorker();
+	void stopWorker();
+	bool isWorkerStopRequested();
+	Frame *acquireFrame();
+	void commitFrame();
+	bool waitForBarrier();
+	void releaseBarrier();
+	void waitUntil(uint32 timeStamp);
+	void presentFrame(const Frame *f);
+	void presentFrames();
+	static void workerThread(void *param);
 	void mainLoop(uint16 offset);
 	void load(uint16 cutName);
 	void prepare();
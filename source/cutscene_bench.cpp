@@ -0,0 +1,280 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef CUTSCENE_BENCHMARK
+
+#include "cutscene.h"
+#include "file.h"
+#include "frame_scheduler.h"
+#include "resource.h"
+#include "systemstub.h"
+#include "game.h"
+
+// Plays the cutscenes without presenting anything : the frames are recorded
+// through the digest callback of Video and the timers are never waited for.
+// Each cutscene is played synchronously then rendered ahead by the worker
+// thread, both must present the same frames.
+struct HeadlessStub : SystemStub {
+	enum {
+		MAX_FRAMES = 5000 // stops a script looping on a key press
+	};
+
+	SystemStub *_stub;
+	Video *_vid;
+	File *_f;
+	const char *_name;
+	uint64 _hash, _lastDigest;
+	uint32 _digestStartUs; // the cutscenes digest a frame right after updateScreen
+	uint32 _framesCount;
+	uint32 _digestTimeUs;
+	uint32 _eventsTimeUs, _lastEventsTimeStamp;
+
+	HeadlessStub(SystemStub *stub, Video *vid, File *f)
+		: _stub(stub), _vid(vid), _f(f) {
+		memset(&_pi, 0, sizeof(_pi));
+		_pi.dbgMask = PlayerInput::DF_FASTMODE;
+		start("");
+	}
+
+	void start(const char *name) {
+		_name = name;
+		_hash = 0;
+		_lastDigest = 0;
+		_digestStartUs = 0;
+		_framesCount = 0;
+		_digestTimeUs = 0;
+		_eventsTimeUs = 0;
+		_lastEventsTimeStamp = 0;
+		_pi.quit = false;
+		_pi.backspace = false;
+	}
+
+	static void frameDigestCallback(void *userData, uint64 d) {
+		((HeadlessStub *)userData)->record(d);
+	}
+
+	void record(uint64 d) {
+		if (_digestStartUs != 0) {
+			_digestTimeUs += _stub->getTimeStampUs() - _digestStartUs;
+			_digestStartUs = 0;
+		}
+		_lastDigest = d;
+		_hash = (_hash ^ d) * 0x100000001B3ULL;
+		char line[64];
+		const int len = snprintf(line, sizeof(line), "%s %d %016llX\n", _name, _framesCount, (unsigned long long)d);
+		_f->write(line, len);
+		++_framesCount;
+		if (_framesCount >= MAX_FRAMES) {
+			warning("Cutscene '%s' still running after %d frames", _name, _framesCount);
+			_pi.quit = true;
+		}
+	}
+
+	virtual void init(const char *title, int w, int h) {}
+	virtual void destroy() {}
+	virtual void setPalette(const uint8 *pal, int n) { _stub->setPalette(pal, n); }
+	virtual void setPaletteEntry(int i, const Color *c) { _stub->setPaletteEntry(i, c); }
+	virtual void getPaletteEntry(int i, Color *c) { _stub->getPaletteEntry(i, c); }
+	virtual void setOverscanColor(int i) {}
+	virtual void copyRect(int x, int y, int w, int h, const uint8 *buf, int pitch) {}
+	virtual void fadeScreen() {}
+	virtual void updateScreen(int shakeOffset) {
+		_digestStartUs = _stub->getTimeStampUs();
+	}
+	virtual void processEvents() {
+		// measures the script execution, the scene loading happens before the first call
+		const uint32 now = _stub->getTimeStampUs();
+		if (_lastEventsTimeStamp != 0) {
+			_eventsTimeUs += now - _lastEventsTimeStamp;
+		}
+		_lastEventsTimeStamp = now;
+	}
+	virtual void sleep(int duration) {}
+	virtual uint32 getTimeStamp() { return _stub->getTimeStamp(); }
+	virtual uint32 getTimeStampUs() { return _stub->getTimeStampUs(); }
+	virtual void startAudio(AudioCallback callback, void *param) {}
+	virtual void stopAudio() {}
+	virtual uint32 getOutputSampleRate() { return _stub->getOutputSampleRate(); }
+	virtual void lockAudio() { _stub->lockAudio(); }
+	virtual void unlockAudio() { _stub->unlockAudio(); }
+	virtual void *createThread(ThreadProc proc, void *param) { return _stub->createThread(proc, param); }
+	virtual void joinThread(void *thread) { _stub->joinThread(thread); }
+	virtual void *createMutex() { return _stub->createMutex(); }
+	virtual void destroyMutex(void *mutex) { _stub->destroyMutex(mutex); }
+	virtual void lockMutex(void *mutex) { _stub->lockMutex(mutex); }
+	virtual void unlockMutex(void *mutex) { _stub->unlockMutex(mutex); }
+	virtual void *createEvent() { return _stub->createEvent(); }
+	virtual void destroyEvent(void *event) { _stub->destroyEvent(event); }
+	virtual void signalEvent(void *event) { _stub->signalEvent(event); }
+	virtual void waitEvent(void *event) { _stub->waitEvent(event); }
+};
+
+static void dumpBenchmark(HeadlessStub *headless, Cutscene *cut) {
+	const uint32 frames = headless->_framesCount ? headless->_framesCount : 1;
+	const uint32 busyTimeUs = cut->_rasterTimeUs + headless->_digestTimeUs;
+	const uint32 interpretTimeUs = headless->_eventsTimeUs > busyTimeUs ? headless->_eventsTimeUs - busyTimeUs : 0;
+	debug(DBG_INFO, "%-8s frames %5d interpret %6d us/frame raster %6d us/frame hash %016llX",
+		headless->_name, headless->_framesCount, interpretTimeUs / frames, cut->_rasterTimeUs / frames, (unsigned long long)headless->_hash);
+}
+
+static bool hasCutsceneData(FileSystem *fs, ResourceType type, const char *name) {
+	char fileName[32];
+	switch (type) {
+	case kResourceTypeAmiga:
+		if (strncmp(name, "INTRO", 5) == 0) {
+			name = "INTRO";
+		}
+		snprintf(fileName, sizeof(fileName), "%s.CMP", name);
+		return File().open(fileName, "rb", fs);
+	case kResourceTypePC:
+		snprintf(fileName, sizeof(fileName), "%s.CMD", name);
+		if (!File().open(fileName, "rb", fs)) {
+			return false;
+		}
+		snprintf(fileName, sizeof(fileName), "%s.POL", name);
+		return File().open(fileName, "rb", fs);
+	}
+	return false;
+}
+
+void Game::benchmarkCutscenes() {
+	_stub->init("REminiscence", Video::GAMESCREEN_W, Video::GAMESCREEN_H);
+
+	_res.load_TEXT();
+
+	switch (_res._type) {
+	case kResourceTypeAmiga:
+		_res.load("FONT8", Resource::OT_FNT, "SPR");
+		break;
+	case kResourceTypePC:
+		_res.load("FB_TXT", Resource::OT_FNT);
+		break;
+	}
+
+	static const char *benchFile = "cutscenes_bench.txt";
+	File f;
+	if (!f.open(benchFile, "wb", _savePath)) {
+		warning("Unable to open '%s' for writing", benchFile);
+		return;
+	}
+	debug(DBG_INFO, "Writing cutscene frame digests to '%s'", benchFile);
+
+	HeadlessStub headless(_stub, &_vid, &f);
+	FrameScheduler frameSched(&headless);
+	Cutscene cut(&_modPly, &_res, &headless, &_vid, &frameSched);
+	_vid.setFrameDigestCallback(HeadlessStub::frameDigestCallback, &headless);
+
+	const uint32 benchStart = _stub->getTimeStampUs();
+	for (uint16 id = 0; id < Cutscene::NUM_CUTSCENES; ++id) {
+		const uint16 cutName = Cutscene::_offsetsTable[id * 2 + 0];
+		const uint16 cutOff  = Cutscene::_offsetsTable[id * 2 + 1];
+		if (cutName == 0xFFFF) {
+			continue;
+		}
+		const char *name = Cutscene::_namesTable[cutName & 0xFF];
+		if (!hasCutsceneData(_fs, _res._type, name)) {
+			warning("Skipping cutscene 0x%02X, no data for '%s'", id, name);
+			continue;
+		}
+		uint64 hashes[2];
+		for (int renderAhead = 0; renderAhead < 2; ++renderAhead) {
+			char label[16];
+			snprintf(label, sizeof(label), "%02X:%s%s", id, name, renderAhead ? "+" : "");
+			headless.start(label);
+			cut._renderAhead = (renderAhead != 0);
+			cut._id = id;
+			cut._textCurBuf = NULL;
+			cut._creditsSequence = false;
+			cut._rasterTimeUs = 0;
+			cut.prepare();
+			cut.load(cutName);
+			cut.mainLoop(cutOff);
+			dumpBenchmark(&headless, &cut);
+			hashes[renderAhead] = headless._hash;
+		}
+		if (hashes[0] != hashes[1]) {
+			warning("Cutscene 0x%02X presents different frames when rendered ahead", id);
+		}
+	}
+
+	uint64 hashes[2];
+	for (int renderAhead = 0; renderAhead < 2; ++renderAhead) {
+		headless.start(renderAhead ? "CREDITS+" : "CREDITS");
+		cut._renderAhead = (renderAhead != 0);
+		cut._id = 0x3D;
+		cut._rasterTimeUs = 0;
+		cut.startCredits();
+		dumpBenchmark(&headless, &cut);
+		hashes[renderAhead] = headless._hash;
+	}
+	if (hashes[0] != hashes[1]) {
+		warning("Credits present different frames when rendered ahead");
+	}
+
+	headless.start("PROTECT");
+	cut._rasterTimeUs = 0;
+	cut.prepare();
+	cut.copyPalette(_protectionPal, 0);
+	cut.updatePalette();
+	cut._gfx.setClippingRect(64, 48, 128, 128);
+	for (int shapeNum = 0; shapeNum < 30; ++shapeNum) {
+		memset(_vid._tempLayer, 0, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
+		for (int16 zoom = 2000; zoom != 0; zoom -= 100) {
+			headless.processEvents();
+			cut.drawProtectionShape(shapeNum, zoom);
+			headless.updateScreen(0);
+			_vid.digestLayer(_vid._tempLayer);
+		}
+		cut.drawProtectionShape(shapeNum, 1);
+		headless.updateScreen(0);
+		_vid.digestLayer(_vid._tempLayer);
+	}
+	headless.processEvents();
+	dumpBenchmark(&headless, &cut);
+
+	// Video::updateScreen only digests again the blocks marked dirty, compare with full digests
+	headless.start("DIGEST");
+	_vid.fullRefresh();
+	uint32 rnd = 0x12345678;
+	int mismatches = 0;
+	for (int frame = 0; frame < 1000; ++frame) {
+		for (int i = 0; i < 4; ++i) {
+			rnd = rnd * 1103515245 + 12345;
+			const int x = (rnd >> 8) % (Video::GAMESCREEN_W - 32);
+			const int y = (rnd >> 16) % (Video::GAMESCREEN_H - 32);
+			const int w = 1 + (rnd >> 4) % 32;
+			const int h = 1 + (rnd >> 12) % 32;
+			for (int j = 0; j < h; ++j) {
+				memset(_vid._frontLayer + (y + j) * Video::GAMESCREEN_W + x, rnd >> 24, w);
+			}
+			_vid.markBlockAsDirty(x, y, w, h);
+		}
+		_vid.updateScreen();
+		if (headless._lastDigest != _vid.computeFrameDigest(_vid._frontLayer)) {
+			++mismatches;
+		}
+	}
+	if (mismatches != 0) {
+		warning("Incremental frame digests differ from the full ones in %d frames", mismatches);
+	}
+	_vid.setFrameDigestCallback(0, 0);
+
+	_modPly.stop();
+	debug(DBG_INFO, "Cutscene benchmark completed in %d ms", (_stub->getTimeStampUs() - benchStart) / 1000);
+}
+
+#endif // CUTSCENE_BENCHMARK
@@ -15,6 +15,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#if !defined(_3DS) && !defined(_WIN32)
+#define FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "archive.h"
 #include "fs.h"
 #ifdef USE_ZLIB
 #include "zlib.h"
@@ -24,14 +32,17 @@
 
 struct File_impl {
 	bool _ioErr;
-	File_impl() : _ioErr(false) {}
+	bool _unpacked;
+	File_impl() : _ioErr(false), _unpacked(false) {}
 	virtual ~File_impl() {}
 	virtual bool open(const char *path, const char *mode) = 0;
 	virtual void close() = 0;
 	virtual uint32 size() = 0;
 	virtual void seek(int32 off) = 0;
-	virtual void read(void *ptr, uint32 len) = 0;
+	virtual uint32 read(void *ptr, uint32 len) = 0;
 	virtual void write(void *ptr, uint32 len) = 0;
+	virtual const uint8 *getData() { return 0; } // whole file, if mapped
+	virtual bool map(FileView *view) { return false; }
 };
 
 struct stdFile : File_impl {
@@ -63,13 +74,15 @@ struct stdFile : File_impl {
 			fseek(_fp, off, SEEK_SET);
 		}
 	}
-	void read(void *ptr, uint32 len) {
+	uint32 read(void *ptr, uint32 len) {
+		uint32 r = 0;
 		if (_fp) {
-			uint32 r = fread(ptr, 1, len, _fp);
+			r = fread(ptr, 1, len, _fp);
 			if (r != len) {
 				_ioErr = true;
 			}
 		}
+		return r;
 	}
 	void write(void *ptr, uint32 len) {
 		if (_fp) {
@@ -81,6 +94,88 @@ struct stdFile : File_impl {
 	}
 };
 
+#ifdef FILE_MMAP
+// read-only file, the File reads go straight to the mapping
+struct mmapFile : File_impl {
+	int _fd;
+	uint8 *_data;
+	uint32 _size, _pos;
+	mmapFile() : _fd(-1), _data(0), _size(0), _pos(0) {}
+	bool open(const char *path, const char *mode) {
+		_ioErr = false;
+		_pos = 0;
+		_fd = ::open(path, O_RDONLY);
+		if (_fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(_fd, &st) != 0) {
+			close();
+			return false;
+		}
+		_size = st.st_size;
+		if (_size != 0) {
+			void *p = mmap(0, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+			if (p != MAP_FAILED) {
+				_data = (uint8 *)p;
+			}
+		}
+		return true;
+	}
+	void close() {
+		if (_data) {
+			munmap(_data, _size);
+			_data = 0;
+		}
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+		_size = 0;
+	}
+	uint32 size() {
+		return _size;
+	}
+	void seek(int32 off) {
+		_pos = off;
+	}
+	uint32 read(void *ptr, uint32 len) {
+		uint32 r = (_pos < _size) ? MIN(len, _size - _pos) : 0;
+		if (_data) {
+			memcpy(ptr, _data + _pos, r);
+		} else if (r != 0) {
+			const int n = pread(_fd, ptr, r, _pos);
+			r = (n < 0) ? 0 : n;
+		}
+		if (r != len) {
+			_ioErr = true;
+		}
+		_pos += r;
+		return r;
+	}
+	void write(void *ptr, uint32 len) {
+		_ioErr = true;
+	}
+	const uint8 *getData() {
+		return _data;
+	}
+	bool map(FileView *view) {
+		if (!_data) {
+			return false;
+		}
+		// separate mapping, the view can outlive the file
+		void *p = mmap(0, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+		if (p == MAP_FAILED) {
+			return false;
+		}
+		view->data = (uint8 *)p;
+		view->size = _size;
+		view->type = FileView::TYPE_MAPPED;
+		return true;
+	}
+};
+#endif
+
 #ifdef USE_ZLIB
 struct zlibFile : File_impl {
 	gzFile _fp;
@@ -111,13 +206,18 @@ struct zlibFile : File_impl {
 			gzseek(_fp, off, SEEK_SET);
 		}
 	}
-	void read(void *ptr, uint32 len) {
+	uint32 read(void *ptr, uint32 len) {
+		int r = 0;
 		if (_fp) {
-			uint32 r = gzread(_fp, ptr, len);
-			if (r != len) {
+			r = gzread(_fp, ptr, len);
+			if (r < 0) {
+				r = 0;
+			}
+			if ((uint32)r != len) {
 				_ioErr = true;
 			}
 		}
+		return r;
 	}
 	void write(void *ptr, uint32 len) {
 		if (_fp) {
@@ -130,9 +230,84 @@ struct zlibFile : File_impl {
 };
 #endif
 
+struct archiveFile : File_impl {
+	Archive *_archive;
+	int _entry;
+	uint32 _pos;
+	archiveFile(Archive *archive, int entry, bool unpacked)
+		: _archive(archive), _entry(entry), _pos(0) {
+		_unpacked = unpacked;
+	}
+	bool open(const char *path, const char *mode) {
+		_ioErr = false;
+		_pos = 0;
+		return mode[0] == 'r';
+	}
+	void close() {
+	}
+	uint32 size() {
+		return _archive->getEntrySize(_entry);
+	}
+	void seek(int32 off) {
+		_pos = off;
+	}
+	uint32 read(void *ptr, uint32 len) {
+		const uint32 size = _archive->getEntrySize(_entry);
+		uint32 r = (_pos < size) ? MIN(len, size - _pos) : 0;
+		if (r != 0 && !_archive->readEntry(_entry, _pos, ptr, r)) {
+			r = 0;
+		}
+		if (r != len) {
+			_ioErr = true;
+		}
+		_pos += r;
+		return r;
+	}
+	void write(void *ptr, uint32 len) {
+		_ioErr = true;
+	}
+	const uint8 *getData() {
+		return _archive->getEntryData(_entry);
+	}
+	bool map(FileView *view) {
+		const uint8 *data = _archive->getEntryData(_entry);
+		if (!data) {
+			return false;
+		}
+		view->data = (uint8 *)data;
+		view->size = _archive->getEntrySize(_entry);
+		view->type = FileView::TYPE_ARCHIVE;
+		return true;
+	}
+};
+
+bool FileView::alloc(uint32 len) {
+	data = (uint8 *)malloc(len ? len : 1);
+	size = data ? len : 0;
+	type = data ? TYPE_COPY : TYPE_NONE;
+	return data != 0;
+}
+
+void FileView::release() {
+	switch (type) {
+	case TYPE_COPY:
+		free(data);
+		break;
+	case TYPE_MAPPED:
+#ifdef FILE_MMAP
+		munmap(data, size);
+#endif
+		break;
+	}
+	data = 0;
+	size = 0;
+	type = TYPE_NONE;
+}
+
 
 File::File()
-	: _impl(0) {
+	: _impl(0), _buf(0), _bufStorage(0), _bufPos(0), _bufLen(0), _implPos(0), _mapped(false) {
+	_name[0] = 0;
 }
 
 File::~File() {
@@ -140,6 +315,7 @@ File::~File() {
 		_impl->close();
 		delete _impl;
 	}
+	free(_bufStorage);
 }
 
 bool File::open(const char *filename, const char *mode, FileSystem *fs) {
@@ -148,12 +324,52 @@ bool File::open(const char *filename, const char *mode, FileSystem *fs) {
 		delete _impl;
 		_impl = 0;
 	}
+	dropBuffer();
+	_implPos = 0;
+	setName(filename);
 	assert(mode[0] != 'z');
-	_impl = new stdFile;
+	bool unpacked = false;
+	if (mode[0] == 'u') {
+		unpacked = true;
+		++mode;
+	}
+	if (fs->_archive) {
+		int entry = -1;
+		if (unpacked) {
+			entry = fs->_archive->findEntry(filename, Archive::ENTRY_UNPACKED);
+		}
+		if (entry < 0) {
+			unpacked = false;
+			entry = fs->_archive->findEntry(filename, 0);
+		}
+		if (entry >= 0) {
+			debug(DBG_FILE, "Open file name '%s' mode '%s' archive entry %d%s", filename, mode, entry, unpacked ? " (unpacked)" : "");
+			_impl = new archiveFile(fs->_archive, entry, unpacked);
+			if (!_impl->open(filename, mode)) {
+				return false;
+			}
+			attachMapping();
+			return true;
+		}
+		_impl = new stdFile;
+		return false;
+	}
+#ifdef FILE_MMAP
+	if (strcmp(mode, "rb") == 0) {
+		_impl = new mmapFile;
+	}
+#endif
+	if (!_impl) {
+		_impl = new stdFile;
+	}
 	const char *path = fs->findPath(filename);
 	if (path) {
 		debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
-		return _impl->open(path, mode);
+		if (!_impl->open(path, mode)) {
+			return false;
+		}
+		attachMapping();
+		return true;
 	}
 	return false;
 }
@@ -164,11 +380,19 @@ bool File::open(const char *filename, const char *mode, const char *directory) {
 		delete _impl;
 		_impl = 0;
 	}
+	dropBuffer();
+	_implPos = 0;
+	setName(filename);
 #ifdef USE_ZLIB
 	if (mode[0] == 'z') {
 		_impl = new zlibFile;
 		++mode;
 	}
+#endif
+#ifdef FILE_MMAP
+	if (!_impl && strcmp(mode, "rb") == 0) {
+		_impl = new mmapFile;
+	}
 #endif
 	if (!_impl) {
 		_impl = new stdFile;
@@ -176,63 +400,202 @@ bool File::open(const char *filename, const char *mode, const char *directory) {
 	char path[512];
 	snprintf(path, sizeof(path), "%s/%s", directory, filename);
 	debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
-	return _impl->open(path, mode);
+	if (!_impl->open(path, mode)) {
+		return false;
+	}
+	attachMapping();
+	return true;
+}
+
+void File::setName(const char *filename) {
+	const char *sep = strrchr(filename, '/');
+	snprintf(_name, sizeof(_name), "%s", sep ? sep + 1 : filename);
 }
 
 void File::close() {
 	if (_impl) {
 		_impl->close();
 	}
+	dropBuffer();
 }
 
 bool File::ioErr() const {
 	return _impl->_ioErr;
 }
 
+bool File::isUnpacked() const {
+	return _impl->_unpacked;
+}
+
 uint32 File::size() {
 	return _impl->size();
 }
 
 void File::seek(int32 off) {
+	if (_mapped) {
+		_bufPos = MIN((uint32)off, _bufLen);
+		return;
+	}
+	const uint32 bufStart = _implPos - _bufLen;
+	if (_bufLen != 0 && (uint32)off >= bufStart && (uint32)off <= _implPos) {
+		_bufPos = off - bufStart;
+		return;
+	}
+	dropBuffer();
 	_impl->seek(off);
+	_implPos = off;
 }
 
-void File::read(void *ptr, uint32 len) {
-	_impl->read(ptr, len);
+void File::skip(uint32 len) {
+	if (len <= _bufLen - _bufPos) {
+		_bufPos += len;
+	} else {
+		seek(tell() + len);
+	}
+}
+
+bool File::peek(void *ptr, uint32 len) {
+	assert(len <= BUFFER_SIZE);
+	if (_bufLen - _bufPos < len && !fillBuffer(len)) {
+		return false;
+	}
+	memcpy(ptr, _buf + _bufPos, len);
+	return true;
 }
 
-uint8 File::readByte() {
-	uint8 b;
-	read(&b, 1);
-	return b;
+bool File::fillBuffer(uint32 len) {
+	if (_mapped) {
+		return _bufLen - _bufPos >= len;
+	}
+	if (!_bufStorage) {
+		_bufStorage = (uint8 *)malloc(BUFFER_SIZE);
+		if (!_bufStorage) {
+			error("Unable to allocate File buffer");
+		}
+	}
+	const uint32 avail = _bufLen - _bufPos;
+	if (avail != 0 && _bufPos != 0) {
+		memmove(_bufStorage, _buf + _bufPos, avail);
+	}
+	_buf = _bufStorage;
+	_bufPos = 0;
+	_bufLen = avail;
+	// reading ahead past the end of the file is not an error
+	const bool ioErr = _impl->_ioErr;
+	const uint32 r = _impl->read(_bufStorage + _bufLen, BUFFER_SIZE - _bufLen);
+	_impl->_ioErr = ioErr;
+	_bufLen += r;
+	_implPos += r;
+	return _bufLen >= len;
 }
 
-uint16 File::readUint16LE() {
-	uint8 lo = readByte();
-	uint8 hi = readByte();
-	return (hi << 8) | lo;
+void File::dropBuffer() {
+	_buf = _bufStorage;
+	_bufPos = _bufLen = 0;
+	_mapped = false;
 }
 
-uint32 File::readUint32LE() {
-	uint16 lo = readUint16LE();
-	uint16 hi = readUint16LE();
-	return (hi << 16) | lo;
+void File::attachMapping() {
+	const uint8 *data = _impl->getData();
+	if (data) {
+		_buf = data;
+		_bufPos = 0;
+		_bufLen = _impl->size();
+		_implPos = _bufLen;
+		_mapped = true;
+	}
 }
 
-uint16 File::readUint16BE() {
-	uint8 hi = readByte();
-	uint8 lo = readByte();
-	return (hi << 8) | lo;
+void File::read(void *ptr, uint32 len) {
+	uint8 *dst = (uint8 *)ptr;
+	const uint32 avail = _bufLen - _bufPos;
+	if (len <= avail) {
+		memcpy(dst, _buf + _bufPos, len);
+		_bufPos += len;
+		return;
+	}
+	if (avail != 0) {
+		memcpy(dst, _buf + _bufPos, avail);
+		dst += avail;
+		len -= avail;
+	}
+	if (_mapped) {
+		_bufPos = _bufLen;
+		_impl->_ioErr = true;
+		return;
+	}
+	dropBuffer();
+	if (len >= BUFFER_SIZE / 2) {
+		_implPos += _impl->read(dst, len);
+		return;
+	}
+	if (!fillBuffer(len)) {
+		memcpy(dst, _buf, _bufLen);
+		_bufPos = _bufLen;
+		_impl->_ioErr = true;
+		return;
+	}
+	memcpy(dst, _buf, len);
+	_bufPos = len;
 }
 
-uint32 File::readUint32BE() {
-	uint16 hi = readUint16BE();
-	uint16 lo = readUint16BE();
-	return (hi << 16) | lo;
+const uint8 *File::readSmallSlow(uint32 len) {
+	static const uint8 zero[8] = { 0 };
+	assert(len <= sizeof(zero));
+	if (!fillBuffer(len)) {
+		_bufPos = _bufLen;
+		_impl->_ioErr = true;
+		return zero;
+	}
+	const uint8 *p = _buf + _bufPos;
+	_bufPos += len;
+	return p;
+}
+
+void File::readUint16LE(uint16 *dst, int count) {
+	read(dst, count * 2);
+	const uint8 *p = (const uint8 *)dst;
+	for (int i = 0; i < count; ++i, p += 2) {
+		dst[i] = READ_LE_UINT16(p);
+	}
+}
+
+void File::readUint16BE(uint16 *dst, int count) {
+	read(dst, count * 2);
+	const uint8 *p = (const uint8 *)dst;
+	for (int i = 0; i < count; ++i, p += 2) {
+		dst[i] = READ_BE_UINT16(p);
+	}
+}
+
+bool File::map(FileView *view, bool writable) {
+	if (!writable && _impl->map(view)) {
+		return true;
+	}
+	const uint32 len = size();
+	if (!view->alloc(len)) {
+		return false;
+	}
+	seek(0);
+	read(view->data, len);
+	if (ioErr()) {
+		view->release();
+		return false;
+	}
+	return true;
 }
 
 void File::write(void *ptr, uint32 len) {
+	if (_bufLen != 0 && !_mapped) {
+		const uint32 pos = tell();
+		if (pos != _implPos) {
+			_impl->seek(pos);
+			_implPos = pos;
+		}
+		dropBuffer();
+	}
 	_impl->write(ptr, len);
+	_implPos += len;
 }
 
 void File::writeByte(uint8 b) {
@@ -23,24 +23,93 @@
 struct File_impl;
 struct FileSystem;
 
+// contents of a whole file, see File::map()
+struct FileView {
+	enum {
+		TYPE_NONE,
+		TYPE_COPY,   // malloc'ed buffer
+		TYPE_MAPPED, // mapping owned by the view
+		TYPE_ARCHIVE // inside the mapping of the data archive
+	};
+
+	uint8 *data; // read-only unless TYPE_COPY
+	uint32 size;
+	uint8 type;
+
+	bool alloc(uint32 len);
+	void release();
+};
+
 struct File {
+	enum {
+		BUFFER_SIZE = 4096
+	};
+
 	File();
 	~File();
 
 	File_impl *_impl;
+	const uint8 *_buf; // data read ahead, or the whole file when _mapped
+	uint8 *_bufStorage; // allocated on the first small read
+	uint32 _bufPos, _bufLen;
+	uint32 _implPos; // position of _impl, the end of the buffered data
+	bool _mapped;
+	char _name[32]; // base name of the opened file
 
+	// a 'u' mode prefix selects the pre-decompressed variant of the data archive if present, see isUnpacked()
 	bool open(const char *filename, const char *mode, FileSystem *fs);
 	bool open(const char *filename, const char *mode, const char *directory);
 	void close();
 	bool ioErr() const;
+	bool isUnpacked() const;
 	uint32 size();
+	uint32 tell() const { return _implPos - (_bufLen - _bufPos); }
 	void seek(int32 off);
+	void skip(uint32 len);
+	bool peek(void *ptr, uint32 len);
 	void read(void *ptr, uint32 len);
-	uint8 readByte();
-	uint16 readUint16LE();
-	uint32 readUint32LE();
-	uint16 readUint16BE();
-	uint32 readUint32BE();
+	// the whole file, pointing into the file mapping when available, a copy
+	// is made on the platforms without mmap or when a writable buffer is needed
+	bool map(FileView *view, bool writable = false);
+	uint8 readByte() {
+		if (_bufPos < _bufLen) {
+			return _buf[_bufPos++];
+		}
+		uint8 b = 0;
+		read(&b, 1);
+		return b;
+	}
+	uint16 readUint16LE() {
+		const uint8 *p = readSmall(2);
+		return READ_LE_UINT16(p);
+	}
+	uint32 readUint32LE() {
+		const uint8 *p = readSmall(4);
+		return READ_LE_UINT32(p);
+	}
+	uint16 readUint16BE() {
+		const uint8 *p = readSmall(2);
+		return READ_BE_UINT16(p);
+	}
+	uint32 readUint32BE() {
+		const uint8 *p = readSmall(4);
+		return READ_BE_UINT32(p);
+	}
+	void readUint16LE(uint16 *dst, int count);
+	void readUint16BE(uint16 *dst, int count);
+	const uint8 *readSmall(uint32 len) {
+		if (_bufLen - _bufPos >= len) {
+			const uint8 *p = _buf + _bufPos;
+			_bufPos += len;
+			return p;
+		}
+		return readSmallSlow(len);
+	}
+	const uint8 *readSmallSlow(uint32 len);
+	bool fillBuffer(uint32 len);
+	void dropBuffer();
+	void attachMapping();
+	void setName(const char *filename);
 	void write(void *ptr, uint32 size);
 	void writeByte(uint8 b);
 	void writeUint16BE(uint16 n);
@@ -0,0 +1,78 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_scheduler.h"
+#include "systemstub.h"
+
+
+FrameScheduler::FrameScheduler(SystemStub *stub)
+	: _stub(stub), _deadline(0), _maxSkip(DEFAULT_MAX_SKIP), _skippedCount(0), _skipFrame(false) {
+	resetStats();
+}
+
+// Starts counting the frame durations from now.
+void FrameScheduler::reset() {
+	_deadline = _stub->getTimeStampUs();
+	_skippedCount = 0;
+	_skipFrame = false;
+}
+
+void FrameScheduler::resetStats() {
+	_onTimeFramesCount = _lateFramesCount = _skippedFramesCount = 0;
+}
+
+// Advances the deadline by the duration of the frame that just ended and
+// returns the time left until it, in us. _skipFrame tells if the next frame
+// should not be presented.
+uint32 FrameScheduler::scheduleFrame(uint32 durationUs) {
+	const uint32 now = _stub->getTimeStampUs();
+	_deadline += durationUs;
+	const int32 ahead = _deadline - now;
+	_skipFrame = false;
+	if (ahead > 0) {
+		++_onTimeFramesCount;
+		_skippedCount = 0;
+		return ahead;
+	}
+	++_lateFramesCount;
+	const uint32 late = -ahead;
+	if (late > durationUs * MAX_LATE_FRAMES) {
+		_deadline = now;
+		_skippedCount = 0;
+	} else if (late >= durationUs && _skippedCount < _maxSkip) {
+		++_skippedCount;
+		++_skippedFramesCount;
+		_skipFrame = true;
+	} else {
+		_skippedCount = 0;
+	}
+	return 0;
+}
+
+// Sleeps until the end of the frame, returns false if the next one should
+// not be presented.
+bool FrameScheduler::waitFrame(uint32 durationUs) {
+	const uint32 pause = scheduleFrame(durationUs) / 1000;
+	if (pause > 0) {
+		_stub->sleep(pause);
+	}
+	return !_skipFrame;
+}
+
+void FrameScheduler::dumpStats(const char *name) const {
+	debug(DBG_INFO, "%s frames: %d on time, %d late, %d skipped", name, _onTimeFramesCount, _lateFramesCount, _skippedFramesCount);
+}
@@ -0,0 +1,56 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_SCHEDULER_H__
+#define FRAME_SCHEDULER_H__
+
+#include "intern.h"
+
+struct SystemStub;
+
+/*
+ * Paces frames against deadlines advanced by the exact frame duration, so
+ * the time lost when sleeping longer than asked is caught up on the next
+ * frames instead of accumulating. When a frame ends a whole frame late,
+ * the presentation of up to _maxSkip following frames can be skipped.
+ * Past MAX_LATE_FRAMES (e.g. after loading or a menu), the deadline is
+ * moved to the current time.
+ */
+struct FrameScheduler {
+	enum {
+		MAX_LATE_FRAMES = 4,
+		DEFAULT_MAX_SKIP = 2
+	};
+
+	SystemStub *_stub;
+	uint32 _deadline; // us
+	int _maxSkip;
+	int _skippedCount; // consecutive frames skipped
+	bool _skipFrame;
+	uint32 _onTimeFramesCount, _lateFramesCount, _skippedFramesCount;
+
+	FrameScheduler(SystemStub *stub);
+
+	void reset();
+	void resetStats();
+	void setMaxSkip(int count) { _maxSkip = count; }
+	uint32 scheduleFrame(uint32 durationUs);
+	bool waitFrame(uint32 durationUs);
+	void dumpStats(const char *name) const;
+};
+
+#endif // FRAME_SCHEDULER_H__
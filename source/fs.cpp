@@ -20,52 +20,299 @@
 #include <windows.h>
 #else
 #include <dirent.h>
-#include <sys/stat.h>
 #endif
+#include <sys/stat.h>
+#include "archive.h"
+#include "file.h"
 #include "fs.h"
 
 
+static const char *INDEX_CACHE_NAME = "rs-files.index";
+
+
 struct FileSystem_impl {
+	// the paths are stored in _pathsPool, files with the same hash of their
+	// upper cased base name are chained in the order of the list
+	struct FileEntry {
+		uint32 path;
+		uint16 pathLen;
+		uint16 nameLen;
+		uint32 hash;
+		int next;
+	};
+
+	// scanned directory, the index cache is valid as long as they are unchanged
+	struct DirEntry {
+		uint32 path;
+		uint32 mtime;
+		uint32 entriesCount; // FAT does not always update the mtime of a directory when its entries change
+	};
+
+	enum {
+		INDEX_CACHE_VERSION = 1
+	};
+
 	FileSystem_impl() :
-		_fileList(0), _fileCount(0), _filePathLen(0) {
+		_fileList(0), _fileCount(0), _fileListSize(0), _dirList(0), _dirCount(0), _dirListSize(0),
+		_pathsPool(0), _pathsPoolLen(0), _pathsPoolSize(0), _hashTable(0), _hashTableSize(0), _filePathLen(0) {
 	}
 
 	~FileSystem_impl() {
-		for (int i = 0; i < _fileCount; ++i) {
-			free(_fileList[i]);
-		}
 		free(_fileList);
+		free(_dirList);
+		free(_pathsPool);
+		free(_hashTable);
 	}
 
-	void setRootDirectory(const char *dir) {
+	void setRootDirectory(const char *dir, const char *cachePath) {
 		_filePathLen = strlen(dir) + 1;
-		buildFileListFromDirectory(dir);
+		const uint32 start = getTimeStampUs();
+		if (cachePath && loadIndexCache(dir, cachePath)) {
+			debug(DBG_INFO, "Loaded the index of '%s' from the cache, %d files in %d directories, %d ms", dir, _fileCount, _dirCount, (getTimeStampUs() - start) / 1000);
+		} else {
+			clearLists();
+			buildFileListFromDirectory(dir);
+			debug(DBG_INFO, "Scanned '%s', %d files in %d directories, %d ms", dir, _fileCount, _dirCount, (getTimeStampUs() - start) / 1000);
+			if (cachePath) {
+				saveIndexCache(dir, cachePath);
+			}
+		}
+		buildHashTable();
+	}
+
+	void clearLists() {
+		_fileCount = 0;
+		_dirCount = 0;
+		_pathsPoolLen = 0;
+	}
+
+	const char *getFilePath(int num) const {
+		return _pathsPool + _fileList[num].path;
 	}
 
 	const char *findFilePath(const char *file) {
 		const int len = strlen(file);
+		const char *name = strrchr(file, '/');
+		name = name ? name + 1 : file;
+		const int nameLen = len - (name - file);
+		if (_hashTableSize != 0) {
+			const uint32 hash = Archive::hashName(name);
+			for (int i = _hashTable[hash & (_hashTableSize - 1)]; i != -1; i = _fileList[i].next) {
+				const FileEntry *e = &_fileList[i];
+				if (e->hash == hash && e->nameLen == nameLen && e->pathLen > len) {
+					const char *filePath = getFilePath(i);
+					if (strcasecmp(filePath + e->pathLen - len, file) == 0) {
+						return filePath;
+					}
+				}
+			}
+		}
+		// the name can also match the end of a longer file name
 		for (int i = 0; i < _fileCount; ++i) {
-			const char *filePath = _fileList[i];
-			const int filePathLen = strlen(filePath);
-			if (filePathLen > len && strcasecmp(filePath + filePathLen - len, file) == 0) {
-				return filePath;
+			const FileEntry *e = &_fileList[i];
+			if (e->nameLen > nameLen && e->pathLen > len) {
+				const char *filePath = getFilePath(i);
+				if (strcasecmp(filePath + e->pathLen - len, file) == 0) {
+					return filePath;
+				}
 			}
 		}
 		return 0;
 	}
 
+	int addPathToPool(const char *path, int len) {
+		if (_pathsPoolLen + len + 1 > _pathsPoolSize) {
+			int size = _pathsPoolSize ? _pathsPoolSize * 2 : 4096;
+			while (_pathsPoolLen + len + 1 > size) {
+				size *= 2;
+			}
+			char *pathsPool = (char *)realloc(_pathsPool, size);
+			if (!pathsPool) {
+				return -1;
+			}
+			_pathsPool = pathsPool;
+			_pathsPoolSize = size;
+		}
+		const int offset = _pathsPoolLen;
+		memcpy(_pathsPool + offset, path, len);
+		_pathsPool[offset + len] = 0;
+		_pathsPoolLen += len + 1;
+		return offset;
+	}
+
 	void addFileToList(const char *filePath) {
-		_fileList = (char **)realloc(_fileList, (_fileCount + 1) * sizeof(char *));
-		if (_fileList) {
-			_fileList[_fileCount] = strdup(filePath);
-			++_fileCount;
+		const int len = strlen(filePath);
+		if (len > 0xFFFF) {
+			return;
+		}
+		if (_fileCount == _fileListSize) {
+			const int size = _fileListSize ? _fileListSize * 2 : 64;
+			FileEntry *fileList = (FileEntry *)realloc(_fileList, size * sizeof(FileEntry));
+			if (!fileList) {
+				return;
+			}
+			_fileList = fileList;
+			_fileListSize = size;
+		}
+		const int offset = addPathToPool(filePath, len);
+		if (offset < 0) {
+			return;
+		}
+		const char *name = strrchr(filePath, '/');
+		name = name ? name + 1 : filePath;
+		FileEntry *e = &_fileList[_fileCount];
+		e->path = offset;
+		e->pathLen = len;
+		e->nameLen = len - (name - filePath);
+		e->hash = Archive::hashName(name);
+		e->next = -1;
+		++_fileCount;
+	}
+
+	void addDirectoryToList(const char *dir, uint32 mtime, uint32 entriesCount) {
+		if (_dirCount == _dirListSize) {
+			const int size = _dirListSize ? _dirListSize * 2 : 16;
+			DirEntry *dirList = (DirEntry *)realloc(_dirList, size * sizeof(DirEntry));
+			if (!dirList) {
+				return;
+			}
+			_dirList = dirList;
+			_dirListSize = size;
+		}
+		const int offset = addPathToPool(dir, strlen(dir));
+		if (offset < 0) {
+			return;
+		}
+		DirEntry *e = &_dirList[_dirCount];
+		e->path = offset;
+		e->mtime = mtime;
+		e->entriesCount = entriesCount;
+		++_dirCount;
+	}
+
+	static bool getDirectoryTime(const char *dir, uint32 *mtime) {
+		struct stat st;
+		if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+			return false;
+		}
+		*mtime = st.st_mtime;
+		return true;
+	}
+
+	static bool readIndexString(File *f, char *buf, int bufSize) {
+		const int len = f->readUint16BE();
+		if (len >= bufSize) {
+			return false;
 		}
+		f->read(buf, len);
+		buf[len] = 0;
+		return !f->ioErr();
+	}
+
+	static void writeIndexString(File *f, const char *s) {
+		const int len = strlen(s);
+		f->writeUint16BE(len);
+		f->write((void *)s, len);
+	}
+
+	bool loadIndexCache(const char *rootDir, const char *cachePath) {
+		File f;
+		if (!f.open(INDEX_CACHE_NAME, "rb", cachePath)) {
+			return false;
+		}
+		char path[512];
+		if (f.readUint32BE() != 0x46424958 || f.readUint16BE() != INDEX_CACHE_VERSION || !readIndexString(&f, path, sizeof(path)) || strcmp(path, rootDir) != 0) {
+			return false;
+		}
+		const int dirCount = f.readUint32BE();
+		const int fileCount = f.readUint32BE();
+		clearLists();
+		for (int i = 0; i < dirCount; ++i) {
+			const uint32 mtime = f.readUint32BE();
+			const uint32 entriesCount = f.readUint32BE();
+			if (!readIndexString(&f, path, sizeof(path))) {
+				return false;
+			}
+			uint32 dirTime;
+			if (!getDirectoryTime(path, &dirTime) || dirTime != mtime) {
+				debug(DBG_FILE, "Directory '%s' modified, rescanning", path);
+				return false;
+			}
+			if (countDirectoryEntries(path) != entriesCount) {
+				debug(DBG_FILE, "Directory '%s' entries changed, rescanning", path);
+				return false;
+			}
+			addDirectoryToList(path, mtime, entriesCount);
+		}
+		for (int i = 0; i < fileCount; ++i) {
+			if (!readIndexString(&f, path, sizeof(path))) {
+				return false;
+			}
+			addFileToList(path);
+		}
+		return !f.ioErr() && _fileCount == fileCount && _dirCount == dirCount;
+	}
+
+	void saveIndexCache(const char *rootDir, const char *cachePath) {
+		File f;
+		if (!f.open(INDEX_CACHE_NAME, "wb", cachePath)) {
+			warning("Unable to save the files index to '%s'", cachePath);
+			return;
+		}
+		f.writeUint32BE(0x46424958); // 'FBIX'
+		f.writeUint16BE(INDEX_CACHE_VERSION);
+		writeIndexString(&f, rootDir);
+		f.writeUint32BE(_dirCount);
+		f.writeUint32BE(_fileCount);
+		for (int i = 0; i < _dirCount; ++i) {
+			f.writeUint32BE(_dirList[i].mtime);
+			f.writeUint32BE(_dirList[i].entriesCount);
+			writeIndexString(&f, _pathsPool + _dirList[i].path);
+		}
+		for (int i = 0; i < _fileCount; ++i) {
+			writeIndexString(&f, getFilePath(i));
+		}
+		if (f.ioErr()) {
+			warning("I/O error when saving the files index to '%s'", cachePath);
+		}
+	}
+
+	void buildHashTable() {
+		free(_hashTable);
+		_hashTable = 0;
+		_hashTableSize = 0;
+		int size = 16;
+		while (size < _fileCount * 2) {
+			size *= 2;
+		}
+		_hashTable = (int *)malloc(size * sizeof(int));
+		if (!_hashTable) {
+			return;
+		}
+		_hashTableSize = size;
+		for (int i = 0; i < size; ++i) {
+			_hashTable[i] = -1;
+		}
+		// inserted backwards to keep the chains in the list order
+		for (int i = _fileCount - 1; i >= 0; --i) {
+			int *head = &_hashTable[_fileList[i].hash & (size - 1)];
+			_fileList[i].next = *head;
+			*head = i;
+		}
+		debug(DBG_FILE, "FileSystem_impl::buildHashTable() files %d buckets %d", _fileCount, size);
 	}
 
 	void buildFileListFromDirectory(const char *dir);
+	static uint32 countDirectoryEntries(const char *dir);
 
-	char **_fileList;
-	int _fileCount;
+	FileEntry *_fileList;
+	int _fileCount, _fileListSize;
+	DirEntry *_dirList;
+	int _dirCount, _dirListSize;
+	char *_pathsPool;
+	int _pathsPoolLen, _pathsPoolSize;
+	int *_hashTable;
+	int _hashTableSize;
 	int _filePathLen;
 };
 
@@ -76,10 +323,12 @@ void FileSystem_impl::buildFileListFromDirectory(const char *dir) {
 	snprintf(searchPath, sizeof(searchPath), "%s/*", dir);
 	HANDLE h = FindFirstFile(searchPath, &findData);
 	if (h) {
+		uint32 entriesCount = 0;
 		do {
 			if (findData.cFileName[0] == '.') {
 				continue;
 			}
+			++entriesCount;
 			char filePath[MAX_PATH];
 			snprintf(filePath, sizeof(filePath), "%s/%s", dir, findData.cFileName);
 			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
@@ -89,17 +338,40 @@ void FileSystem_impl::buildFileListFromDirectory(const char *dir) {
 			}
 		} while (FindNextFile(h, &findData));
 		FindClose(h);
+		uint32 mtime;
+		if (getDirectoryTime(dir, &mtime)) {
+			addDirectoryToList(dir, mtime, entriesCount);
+		}
+	}
+}
+
+uint32 FileSystem_impl::countDirectoryEntries(const char *dir) {
+	uint32 count = 0;
+	WIN32_FIND_DATA findData;
+	char searchPath[MAX_PATH];
+	snprintf(searchPath, sizeof(searchPath), "%s/*", dir);
+	HANDLE h = FindFirstFile(searchPath, &findData);
+	if (h) {
+		do {
+			if (findData.cFileName[0] != '.') {
+				++count;
+			}
+		} while (FindNextFile(h, &findData));
+		FindClose(h);
 	}
+	return count;
 }
 #else
 void FileSystem_impl::buildFileListFromDirectory(const char *dir) {
 	DIR *d = opendir(dir);
 	if (d) {
+		uint32 entriesCount = 0;
 		dirent *de;
 		while ((de = readdir(d)) != NULL) {
 			if (de->d_name[0] == '.') {
 				continue;
 			}
+			++entriesCount;
 			char filePath[512];
 			snprintf(filePath, sizeof(filePath), "%s/%s", dir, de->d_name);
 			struct stat st;
@@ -112,16 +384,47 @@ void FileSystem_impl::buildFileListFromDirectory(const char *dir) {
 			}
 		}
 		closedir(d);
+		uint32 mtime;
+		if (getDirectoryTime(dir, &mtime)) {
+			addDirectoryToList(dir, mtime, entriesCount);
+		}
+	}
+}
+
+uint32 FileSystem_impl::countDirectoryEntries(const char *dir) {
+	uint32 count = 0;
+	DIR *d = opendir(dir);
+	if (d) {
+		dirent *de;
+		while ((de = readdir(d)) != NULL) {
+			if (de->d_name[0] != '.') {
+				++count;
+			}
+		}
+		closedir(d);
 	}
+	return count;
 }
 #endif
 
-FileSystem::FileSystem(const char *dataPath) {
+static const char *ARCHIVE_NAME = "FLASHBACK.PAK";
+
+FileSystem::FileSystem(const char *dataPath, const char *cachePath) {
 	_impl = new FileSystem_impl;
-	_impl->setRootDirectory(dataPath);
+	_archive = new Archive;
+	char archivePath[512];
+	snprintf(archivePath, sizeof(archivePath), "%s/%s", dataPath, ARCHIVE_NAME);
+	if (_archive->open(archivePath)) {
+		debug(DBG_INFO, "Using data archive '%s'", archivePath);
+	} else {
+		delete _archive;
+		_archive = 0;
+		_impl->setRootDirectory(dataPath, cachePath);
+	}
 }
 
 FileSystem::~FileSystem() {
+	delete _archive;
 	delete _impl;
 }
 
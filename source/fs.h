@@ -20,13 +20,15 @@
 
 #include "intern.h"
 
+struct Archive;
 struct FileSystem_impl;
 
 struct FileSystem {
-	FileSystem(const char *dataPath);
+	FileSystem(const char *dataPath, const char *cachePath = 0); // the files index is cached in cachePath
 	~FileSystem();
 
 	FileSystem_impl *_impl;
+	Archive *_archive; // FLASHBACK.PAK of the data directory, replaces the files scan
 
 	const char *findPath(const char *filename);
 };
@@ -16,6 +16,7 @@
  */
 
 #include <ctime>
+#include "archive.h"
 #include "file.h"
 #include "systemstub.h"
 #include "unpack.h"
@@ -24,15 +25,18 @@
 
 
 Game::Game(SystemStub *stub, FileSystem *fs, const char *savePath, int level, ResourceType ver, Language lang)
-	: _cut(&_modPly, &_res, stub, &_vid), _menu(&_modPly, &_res, stub, &_vid),
-	_mix(stub), _modPly(&_mix, fs), _res(fs, ver, lang), _seqPly(stub, &_mix), _sfxPly(&_mix), _vid(&_res, stub),
-	_stub(stub), _fs(fs), _savePath(savePath) {
+	: _cut(&_modPly, &_res, stub, &_vid, &_frameSched), _menu(&_modPly, &_res, stub, &_vid),
+	_mix(stub), _modPly(&_mix, fs), _res(fs, ver, lang), _seqPly(stub, &_mix, &_frameSched), _sfxPly(&_mix), _vid(&_res, stub),
+	_stub(stub), _fs(fs), _savePath(savePath), _capture(stub), _frameSched(stub) {
 	_stateSlot = 1;
 	_inp_demo = 0;
 	_inp_record = false;
 	_inp_replay = false;
 	_skillLevel = 1;
 	_currentLevel = level;
+	_levelLoader = 0;
+	_archiveMutex = 0;
+	_levelLoadPending = false;
 }
 
 void Game::run() {
@@ -40,6 +44,12 @@ void Game::run() {
 
 	_randSeed = time(0);
 
+	if (_fs->_archive) {
+		_archiveMutex = _stub->createMutex();
+		_fs->_archive->setLock(_stub, _archiveMutex);
+	}
+	_res.openUnpackCache(_savePath, false);
+
 	_res.load_TEXT();
 
 	switch (_res._type) {
@@ -97,7 +107,14 @@ void Game::run() {
 
 	_res.free_TEXT();
 
+	_capture.stop();
+	_vid._capture = 0;
 	_mix.free();
+	if (_archiveMutex) {
+		_fs->_archive->setLock(0, 0);
+		_stub->destroyMutex(_archiveMutex);
+		_archiveMutex = 0;
+	}
 	_stub->destroy();
 }
 
@@ -127,10 +144,20 @@ void Game::mainLoop() {
 	_vid._unkPalSlot1 = 0;
 	_vid._unkPalSlot2 = 0;
 	_score = 0;
-	loadLevelData();
-	resetGameState();
+	startLoadLevelData();
+	_frameSched.reset();
+	_frameSched.resetStats();
 	while (!_stub->_pi.quit) {
 		playCutscene();
+		if (_levelLoadPending) {
+			finishLoadLevelData();
+			if (_levelLoadChange) {
+				loadLevelMap();
+				_vid.fullRefresh();
+			} else {
+				resetGameState();
+			}
+		}
 		if (_cut._id == 0x3D) {
 			showFinalScore();
 			break;
@@ -148,14 +175,14 @@ void Game::mainLoop() {
 							break;
 						}
 					} else {
-						loadLevelData();
-						resetGameState();
+						startLoadLevelData();
 					}
 					continue;
 				}
 
 			}
 		}
+		uint32 phaseStart = _stub->getTimeStampUs();
 		memcpy(_vid._frontLayer, _vid._backLayer, Video::GAMESCREEN_W * Video::GAMESCREEN_H);
 		pge_getInput();
 		pge_prepare();
@@ -185,6 +212,9 @@ void Game::mainLoop() {
 				_vid.fullRefresh();
 			}
 		}
+		uint32 phaseEnd = _stub->getTimeStampUs();
+		_capture.setPhaseTime(Capture::PHASE_LOGIC, phaseEnd - phaseStart);
+		phaseStart = phaseEnd;
 		prepareAnims();
 		drawAnims();
 		drawCurrentInventoryItem();
@@ -193,8 +223,17 @@ void Game::mainLoop() {
 		if (_blinkingConradCounter != 0) {
 			--_blinkingConradCounter;
 		}
-		_vid.updateScreen();
+		phaseEnd = _stub->getTimeStampUs();
+		_capture.setPhaseTime(Capture::PHASE_DRAW, phaseEnd - phaseStart);
+		phaseStart = phaseEnd;
+		if (!_frameSched._skipFrame) {
+			_vid.updateScreen();
+		}
+		phaseEnd = _stub->getTimeStampUs();
+		_capture.setPhaseTime(Capture::PHASE_PRESENT, phaseEnd - phaseStart);
+		phaseStart = phaseEnd;
 		updateTiming();
+		_capture.setPhaseTime(Capture::PHASE_WAIT, _stub->getTimeStampUs() - phaseStart);
 		drawStoryTexts();
 		if (_stub->_pi.backspace) {
 			_stub->_pi.backspace = false;
@@ -208,17 +247,13 @@ void Game::mainLoop() {
 		}
 		inp_handleSpecialKeys();
 	}
+	finishLoadLevelData();
+	_frameSched.dumpStats("Game");
 }
 
 void Game::updateTiming() {
-	static uint32 tstamp = 0;
-	int32 delay = _stub->getTimeStamp() - tstamp;
-	int32 pause = (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) ? 20 : 30;
-	pause -= delay;
-	if (pause > 0) {
-		_stub->sleep(pause);
-	}
-	tstamp = _stub->getTimeStamp();
+	const int frameDuration = (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) ? 20 : 30;
+	_frameSched.waitFrame(frameDuration * 1000);
 }
 
 void Game::playCutscene(int id) {
@@ -315,6 +350,22 @@ void Game::inp_handleSpecialKeys() {
 		}
 		_stub->_pi.stateSlot = 0;
 	}
+	if (_stub->_pi.capture) {
+		if (_capture.isActive()) {
+			debug(DBG_INFO, "Stop capturing frames");
+			_capture.stop();
+			_vid._capture = 0;
+		} else {
+			char captureFile[32];
+			makeGameCaptureName(captureFile);
+			if (_capture.start(captureFile, _savePath, Video::GAMESCREEN_W, Video::GAMESCREEN_H, Video::SCREENBLOCK_W, Video::SCREENBLOCK_H)) {
+				debug(DBG_INFO, "Capturing frames to '%s'", captureFile);
+				_vid._capture = &_capture;
+				_vid.fullRefresh();
+			}
+		}
+		_stub->_pi.capture = false;
+	}
 	if (_stub->_pi.inpRecord || _stub->_pi.inpReplay) {
 		bool replay = false;
 		bool record = false;
@@ -1223,8 +1274,27 @@ void Game::loadLevelMap() {
 	}
 }
 
-void Game::loadLevelData() {
+// The level files are read and decompressed by a thread while the level
+// cutscene plays, finishLoadLevelData() waits for it before the first frame.
+void Game::startLoadLevelData(bool changeLevel) {
+	assert(!_levelLoadPending);
 	_res.clearLevelRes();
+	_cut._id = _gameLevels[_currentLevel].cutscene_id;
+	_levelLoadPending = true;
+	_levelLoadChange = changeLevel;
+	_levelLoader = _stub->createThread(levelLoaderThread, this);
+	if (!_levelLoader) {
+		warning("Unable to start the level loader thread, loading synchronously");
+		loadLevelFiles();
+	}
+}
+
+void Game::levelLoaderThread(void *param) {
+	((Game *)param)->loadLevelFiles();
+}
+
+void Game::loadLevelFiles() {
+	const uint32 startUs = _stub->getTimeStampUs();
 	const Level *lvl = &_gameLevels[_currentLevel];
 	switch (_res._type) {
 	case kResourceTypeAmiga:
@@ -1274,8 +1344,20 @@ void Game::loadLevelData() {
 		_res.load(lvl->name2, Resource::OT_TBN);
 		break;
 	}
+	_levelLoadTimeUs = _stub->getTimeStampUs() - startUs;
+}
 
-	_cut._id = lvl->cutscene_id;
+void Game::finishLoadLevelData() {
+	if (!_levelLoadPending) {
+		return;
+	}
+	const uint32 startUs = _stub->getTimeStampUs();
+	if (_levelLoader) {
+		_stub->joinThread(_levelLoader);
+		_levelLoader = 0;
+	}
+	_levelLoadPending = false;
+	debug(DBG_INFO, "Level %d files loaded in %d ms, waited %d ms", _currentLevel, _levelLoadTimeUs / 1000, (_stub->getTimeStampUs() - startUs) / 1000);
 
 	_curMonsterNum = 0xFFFF;
 	_curMonsterFrame = 0;
@@ -1371,11 +1453,9 @@ uint16 Game::getRandomNumber() {
 
 void Game::changeLevel() {
 	_vid.fadeOut();
-	loadLevelData();
-	loadLevelMap();
+	startLoadLevelData(true);
 	_vid.setPalette0xF();
 	_vid.setTextPalette();
-	_vid.fullRefresh();
 }
 
 uint16 Game::getLineLength(const uint8 *str) const {
@@ -1548,6 +1628,10 @@ void Game::makeGameDemoName(char *buf) {
 	sprintf(buf, "rs-level%d.demo", _currentLevel + 1);
 }
 
+void Game::makeGameCaptureName(char *buf) {
+	sprintf(buf, "rs-level%d-%u.capture", _currentLevel + 1, (uint32)time(0));
+}
+
 void Game::makeGameStateName(uint8 slot, char *buf) {
 	sprintf(buf, "rs-level%d-%02d.state", _currentLevel + 1, slot);
 }
@@ -19,7 +19,9 @@
 #define GAME_H__
 
 #include "intern.h"
+#include "capture.h"
 #include "cutscene.h"
+#include "frame_scheduler.h"
 #include "fs.h"
 #include "menu.h"
 #include "mixer.h"
@@ -98,17 +100,29 @@ struct Game {
 	AnimBuffers _animBuffers;
 	uint16 _deathCutsceneCounter;
 	bool _saveStateCompleted;
+	void *_levelLoader; // thread reading the level files while the level cutscene plays
+	void *_archiveMutex;
+	bool _levelLoadPending;
+	bool _levelLoadChange; // changeLevel() during the game, the room is loaded once the files are read
+	uint32 _levelLoadTimeUs;
 
 	Game(SystemStub *, FileSystem *, const char *savePath, int level, ResourceType ver, Language lang);
 
 	void run();
+#ifdef CUTSCENE_BENCHMARK
+	void benchmarkCutscenes();
+#endif
+	void prewarmUnpackCache();
 	void resetGameState();
 	void mainLoop();
 	void updateTiming();
 	void playCutscene(int id = -1);
 	bool playCutsceneSeq(const char *name);
 	void loadLevelMap();
-	void loadLevelData();
+	void startLoadLevelData(bool changeLevel = false);
+	void loadLevelFiles();
+	static void levelLoaderThread(void *param);
+	void finishLoadLevelData();
 	void drawIcon(uint8 iconNum, int16 x, int16 y, uint8 colMask);
 	void drawCurrentInventoryItem();
 	void printLevelCode();
@@ -367,6 +381,8 @@ struct Game {
 	bool _inp_replay;
 	bool _inp_record;
 	File *_inp_demo;
+	Capture _capture;
+	FrameScheduler _frameSched;
 
 	void inp_handleSpecialKeys();
 	void inp_update();
@@ -377,6 +393,7 @@ struct Game {
 	bool _validSaveState;
 
 	void makeGameDemoName(char *buf);
+	void makeGameCaptureName(char *buf);
 	void makeGameStateName(uint8 slot, char *buf);
 	bool saveGameState(uint8 slot);
 	bool loadGameState(uint8 slot);
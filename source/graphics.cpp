@@ -26,10 +26,16 @@ void Graphics::setClippingRect(int16 rx, int16 ry, int16 rw, int16 rh) {
 	_crh = rh;
 }
 
+void Graphics::resetDirtyRect() {
+	_dirtyX1 = _dirtyY1 = 0x7FFF;
+	_dirtyX2 = _dirtyY2 = -1;
+}
+
 void Graphics::drawPoint(uint8 color, const Point *pt) {
 	debug(DBG_VIDEO, "Graphics::drawPoint() col=0x%X x=%d, y=%d", color, pt->x, pt->y);
 	if (pt->x >= 0 && pt->x < _crw && pt->y >= 0 && pt->y < _crh) {
 		*(_layer + (pt->y + _cry) * 256 + pt->x + _crx) = color;
+		addDirtySpan(pt->y, pt->x, pt->x);
 	}
 }
 
@@ -103,8 +109,153 @@ void Graphics::addEllipseRadius(int16 y, int16 x1, int16 x2) {
 	}
 }
 
+// Same outline stepping as drawEllipseUncached, for an ellipse centered at
+// the origin. Records the half width of each row 0 to ry (the last value
+// set for a row is the one filled), returns false if a row is not set,
+// which happens with the larger radii.
+static bool calcEllipseHalfWidths(int16 rx, int16 ry, int16 *halfWidths) {
+	for (int i = 0; i <= ry; ++i) {
+		halfWidths[i] = -1;
+	}
+	bool flag = false;
+	int32 dy = 0;
+	int32 rxsq  = rx * rx;
+	int32 rxsq2 = rx * rx * 2;
+	int32 rxsq4 = rx * rx * 4;
+	int32 rysq  = ry * ry;
+	int32 rysq2 = ry * ry * 2;
+	int32 rysq4 = ry * ry * 4;
+
+	int32 dx = 0;
+	int32 b = rx * ((rysq2 & 0xFFFF) + (rysq2 >> 16));
+	int32 a = 2 * b;
+
+	int32 ny1, ny2, nx1, nx2;
+	ny1 = ny2 = rysq4 / 2 - a + rxsq;
+	nx1 = nx2 = rxsq2 - b + rysq;
+
+	while (ny2 < 0) {
+		if (rx != 0 && dy <= ry) {
+			halfWidths[dy] = rx;
+		}
+		dy += 1;
+		dx += rxsq4;
+		nx1 = dx;
+		if (nx2 < 0) {
+			nx2 += nx1 + rxsq2;
+			ny2 += nx1;
+		} else {
+			--rx;
+			a -= rysq4;
+			ny1 = a;
+			nx2 += nx1 + rxsq2 - ny1;
+			ny2 += nx1 + rysq2 - ny1;
+		}
+	}
+
+	while (rx >= 0) {
+		if (!flag && rx != 0) {
+			if (dy <= ry) {
+				halfWidths[dy] = rx;
+			}
+			flag = true;
+		}
+		--rx;
+		a -= rysq4;
+		nx1 = a;
+		if (ny2 < 0) {
+			++dy;
+			flag = false;
+			dx += rxsq4;
+			ny2 += dx - nx1 + rysq2;
+			ny1 = dx - nx1 + rysq2;
+		} else {
+			ny2 += rysq2 - nx1;
+			ny1 = rysq2 - nx1;
+		}
+	}
+	if (flag) {
+		++dy;
+	}
+
+	for (; dy <= ry; ++dy) {
+		halfWidths[dy] = 0;
+	}
+	for (int i = 0; i <= ry; ++i) {
+		if (halfWidths[i] < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Graphics::Graphics()
+	: _ellipseCacheCounter(0) {
+	resetDirtyRect();
+	for (int i = 0; i < ELLIPSE_CACHE_SIZE; ++i) {
+		_ellipseCache[i].rx = _ellipseCache[i].ry = -1;
+		_ellipseCache[i].lastUse = 0;
+	}
+}
+
+// Least recently used cache of the ellipses half widths, returns 0 when
+// the radii are not cacheable.
+const Graphics::EllipseSpans *Graphics::findEllipseSpans(int16 rx, int16 ry) {
+	if (rx < 0 || ry < 0 || rx > ELLIPSE_CACHE_MAX_RADIUS || ry > ELLIPSE_CACHE_MAX_RADIUS) {
+		return 0;
+	}
+	++_ellipseCacheCounter;
+	EllipseSpans *es = &_ellipseCache[0];
+	for (int i = 0; i < ELLIPSE_CACHE_SIZE; ++i) {
+		EllipseSpans *e = &_ellipseCache[i];
+		if (e->rx == rx && e->ry == ry) {
+			e->lastUse = _ellipseCacheCounter;
+			return e->valid ? e : 0;
+		}
+		if (e->lastUse < es->lastUse) {
+			es = e;
+		}
+	}
+	es->rx = rx;
+	es->ry = ry;
+	es->lastUse = _ellipseCacheCounter;
+	es->valid = calcEllipseHalfWidths(rx, ry, es->halfWidths);
+	return es->valid ? es : 0;
+}
+
 void Graphics::drawEllipse(uint8 color, bool hasAlpha, const Point *pt, int16 rx, int16 ry) {
 	debug(DBG_VIDEO, "Graphics::drawEllipse()");
+	const EllipseSpans *es = findEllipseSpans(rx, ry);
+	if (!es) {
+		drawEllipseUncached(color, hasAlpha, pt, rx, ry);
+		return;
+	}
+	int16 y = pt->y - ry;
+	if (y < 0) {
+		y = 0;
+	}
+	if (y < _crh && pt->y + ry >= 0) {
+		int16 y2 = pt->y + ry + 1;
+		if (y2 > _crh) {
+			y2 = _crh;
+		}
+		for (; y < y2; ++y) {
+			const int16 h = es->halfWidths[ABS(y - pt->y)];
+			int16 x1 = pt->x - h;
+			int16 x2 = pt->x + h;
+			if (x1 < 0) {
+				x1 = 0;
+			}
+			if (x2 >= _crw) {
+				x2 = _crw - 1;
+			}
+			drawSpan(y, x1, x2, color, hasAlpha);
+		}
+	}
+}
+
+void Graphics::drawEllipseUncached(uint8 color, bool hasAlpha, const Point *pt, int16 rx, int16 ry) {
+	debug(DBG_VIDEO, "Graphics::drawEllipseUncached()");
 	bool flag = false;
 	int16 y = pt->y - ry;
 	if (y < 0) {
@@ -209,32 +360,77 @@ void Graphics::drawEllipse(uint8 color, bool hasAlpha, const Point *pt, int16 rx
 	}
 }
 
+typedef uint32 uint32_alias __attribute__((__may_alias__));
+
+void fillSpan(uint8 *dst, int len, uint8 color) {
+	memset(dst, color, len);
+}
+
+// ORs mask into len bytes, 4 bytes at a time once dst is aligned
+void fillSpanOr(uint8 *dst, int len, uint8 mask) {
+	for (; len > 0 && ((uintptr_t)dst & 3) != 0; --len) {
+		*dst++ |= mask;
+	}
+	const uint32 mask32 = mask * 0x01010101;
+	uint32_alias *dst32 = (uint32_alias *)dst;
+	for (; len >= 16; len -= 16) {
+		dst32[0] |= mask32;
+		dst32[1] |= mask32;
+		dst32[2] |= mask32;
+		dst32[3] |= mask32;
+		dst32 += 4;
+	}
+	for (; len >= 4; len -= 4) {
+		*dst32++ |= mask32;
+	}
+	dst = (uint8 *)dst32;
+	for (; len > 0; --len) {
+		*dst++ |= mask;
+	}
+}
+
+// Fills the columns x1 to x2 of a clipping rectangle row, with the same
+// translucency rule as fillArea.
+void Graphics::drawSpan(int16 y, int16 x1, int16 x2, uint8 color, bool hasAlpha) {
+	if (y < 0 || y >= _crh || x1 < 0 || x2 >= _crw || x2 < x1) {
+		return;
+	}
+	uint8 *dst = _layer + (_cry + y) * 256 + _crx + x1;
+	addDirtySpan(y, x1, x2);
+	if (hasAlpha && color > 0xC7) {
+		fillSpanOr(dst, x2 - x1 + 1, color & 8); // XXX 0x88
+	} else {
+		fillSpan(dst, x2 - x1 + 1, color);
+	}
+}
+
 void Graphics::fillArea(uint8 color, bool hasAlpha) {
 	debug(DBG_VIDEO, "Graphics::fillArea()");
 	int16 *pts = _areaPoints;
-	uint8 *dst = _layer + (_cry + *pts++) * 256 + _crx;
+	int16 y = *pts++;
+	uint8 *dst = _layer + (_cry + y) * 256 + _crx;
 	int16 x1 = *pts++;
 	if (x1 >= 0) {
 		if (hasAlpha && color > 0xC7) {
 			do {
 				int16 x2 = *pts++;
 				if (x2 < _crw && x2 >= x1) {
-					int len = x2 - x1 + 1;
-					for (int i = 0; i < len; ++i) {
-						*(dst + x1 + i) |= color & 8; // XXX 0x88
-					}
+					fillSpanOr(dst + x1, x2 - x1 + 1, color & 8); // XXX 0x88
+					addDirtySpan(y, x1, x2);
 				}
 				dst += 256;
+				++y;
 				x1 = *pts++;
 			} while (x1 >= 0);
 		} else {
 			do {
 				int16 x2 = *pts++;
 				if (x2 < _crw && x2 >= x1) {
-					int len = x2 - x1 + 1;
-					memset(dst + x1, color, len);
+					fillSpan(dst + x1, x2 - x1 + 1, color);
+					addDirtySpan(y, x1, x2);
 				}
 				dst += 256;
+				++y;
 				x1 = *pts++;
 			} while (x1 >= 0);
 		}
@@ -264,11 +460,7 @@ void Graphics::drawSegment(uint8 color, bool hasAlpha, int16 ys, const Point *pt
 	if (xmax >= _crw) {
 		xmax = _crw - 1;
 	}
-	_areaPoints[0] = ys;
-	_areaPoints[1] = xmin;
-	_areaPoints[2] = xmax;
-	_areaPoints[3] = -1;
-	fillArea(color, hasAlpha);
+	drawSpan(ys, xmin, xmax, color, hasAlpha);
 }
 
 void Graphics::drawPolygonOutline(uint8 color, const Point *pts, uint8 numPts) {
@@ -350,10 +542,11 @@ static void drawPolygonHelper2(int32 &x, int16 &y, int32 &step, int16 *&pts, int
 
 void Graphics::drawPolygon(uint8 color, bool hasAlpha, const Point *pts, uint8 numPts) {
 	debug(DBG_VIDEO, "Graphics::drawPolygon()");
-	assert(numPts * 4 < 0x100);
 
-	int16 *apts1 = &_areaPoints[0x100];
-	int16 *apts2 = &_areaPoints[0x100 + numPts * 2];
+	// the vertices are stored twice in a row, so both edges can be walked
+	// without wrapping around
+	int16 *apts1 = &_polygonPoints[0];
+	int16 *apts2 = &_polygonPoints[numPts * 2];
 
 	int16 xmin, xmax, ymin, ymax;
 	xmin = xmax = pts[0].x;
@@ -383,7 +576,6 @@ void Graphics::drawPolygon(uint8 color, bool hasAlpha, const Point *pts, uint8 n
 			xmax = x;
 		}
 	}
-	int16 *rpts = _areaPoints;
 	if (xmax < 0 || xmin >= _crw || ymax < 0 || ymin >= _crh) {
 		return;
 	}
@@ -396,6 +588,7 @@ void Graphics::drawPolygon(uint8 color, bool hasAlpha, const Point *pts, uint8 n
 		return;
 	}
 	int16 x, dx, y, dy;
+	int16 spanY;
 	int32 a, b, d, f;
 	int32 xstep1 = 0;
 	int32 xstep2 = 0;
@@ -451,11 +644,11 @@ void Graphics::drawPolygon(uint8 color, bool hasAlpha, const Point *pts, uint8 n
 		d /= 2;
 		f += d;
 		ymin = 0;
-		*rpts++ = 0;
+		spanY = 0;
 		goto gfx_startLine;
 	}
 
-	*rpts++ = ymin;
+	spanY = ymin;
 
 gfx_startNewLine:
 	drawPolygonHelper2(f, ymin, xstep2, apts1, spts);
@@ -490,8 +683,7 @@ gfx_startNewLine:
 	if (x > xmax) {
 		x = xmax;
 	}
-	*rpts++ = d >> 16;
-	*rpts++ = x;
+	drawSpan(spanY++, d >> 16, x, color, hasAlpha);
 	++ymin;
 	d = xstep1;
 	if (d >= 0) {
@@ -532,8 +724,7 @@ gfx_startLine:
 					if (x > xmax) {
 						x = xmax;
 					}
-					*rpts++ = a >> 16;
-					*rpts++ = x;
+					drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 					b += xstep1;
 					f += xstep2;
 					--dy;
@@ -556,8 +747,7 @@ gfx_startLine:
 				if (x > xmax) {
 					x = xmax;
 				}
-				*rpts++ = d >> 16;
-				*rpts++ = x;
+				drawSpan(spanY++, d >> 16, x, color, hasAlpha);
 				++ymin;
 				d = xstep2;
 				if (d >= l2) {
@@ -581,8 +771,7 @@ gfx_startLine:
 					if (x > xmax) {
 						x = xmax;
 					}
-					*rpts++ = a >> 16;
-					*rpts++ = x;
+					drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 					b += xstep1;
 					f += xstep2;
 					--dy;
@@ -604,8 +793,7 @@ gfx_startLine:
 					if (x > xmax) {
 						x = xmax;
 					}
-					*rpts++ = a >> 16;
-					*rpts++ = x;
+					drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 					b += xstep1;
 					f += xstep2;
 					--dy;
@@ -628,8 +816,7 @@ gfx_startLine:
 				if (x > xmax) {
 					x = xmax;
 				}
-				*rpts++ = d >> 16;
-				*rpts++ = x;
+				drawSpan(spanY++, d >> 16, x, color, hasAlpha);
 				++ymin;
 				d = xstep1;
 				if (d <= l1) {
@@ -656,8 +843,7 @@ gfx_startLine:
 			if (x > xmax) {
 				x = xmax;
 			}
-			*rpts++ = a >> 16;
-			*rpts++ = x;
+			drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 			b += xstep1;
 			f += xstep2;
 			--dy;
@@ -687,8 +873,7 @@ gfx_endLine:
 	if (x > xmax) {
 		x = xmax;
 	}
-	*rpts++ = a >> 16;
-	*rpts++ = x;
+	drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 	goto gfx_fillArea;
 
 gfx_drawPolygonEnd:
@@ -703,8 +888,7 @@ gfx_drawPolygonEnd:
 			if (x > xmax) {
 				x = xmax;
 			}
-			*rpts++ = a >> 16;
-			*rpts++ = x;
+			drawSpan(spanY++, a >> 16, x, color, hasAlpha);
 			b += xstep1;
 			f += xstep2;
 			--dy;
@@ -712,6 +896,5 @@ gfx_drawPolygonEnd:
 	}
 
 gfx_fillArea:
-	*rpts++ = -1;
-	fillArea(color, hasAlpha);
+	return;
 }
@@ -20,16 +20,47 @@
 
 #include "intern.h"
 
+void fillSpan(uint8 *dst, int len, uint8 color);
+void fillSpanOr(uint8 *dst, int len, uint8 mask);
+
 struct Graphics {
+	enum {
+		ELLIPSE_CACHE_SIZE = 8,
+		ELLIPSE_CACHE_MAX_RADIUS = 255
+	};
+
+	struct EllipseSpans {
+		int16 rx, ry;
+		bool valid;
+		uint32 lastUse;
+		int16 halfWidths[ELLIPSE_CACHE_MAX_RADIUS + 1];
+	};
+
 	uint8 *_layer;
 	int16 _areaPoints[0x200];
+	int16 _polygonPoints[256 * 2 * 2];
 	int16 _crx, _cry, _crw, _crh;
+	EllipseSpans _ellipseCache[ELLIPSE_CACHE_SIZE];
+	uint32 _ellipseCacheCounter;
+	int16 _dirtyX1, _dirtyY1, _dirtyX2, _dirtyY2; // area drawn since resetDirtyRect(), clipping rectangle coordinates
+
+	Graphics();
 
 	void setClippingRect(int16 vx, int16 vy, int16 vw, int16 vh);
+	void resetDirtyRect();
+	void addDirtySpan(int16 y, int16 x1, int16 x2) {
+		if (x1 < _dirtyX1) _dirtyX1 = x1;
+		if (x2 > _dirtyX2) _dirtyX2 = x2;
+		if (y < _dirtyY1) _dirtyY1 = y;
+		if (y > _dirtyY2) _dirtyY2 = y;
+	}
 	void drawPoint(uint8 color, const Point *pt);
 	void drawLine(uint8 color, const Point *pt1, const Point *pt2);
 	void addEllipseRadius(int16 y, int16 x1, int16 x2);
+	const EllipseSpans *findEllipseSpans(int16 rx, int16 ry);
 	void drawEllipse(uint8 color, bool hasAlpha, const Point *pt, int16 rx, int16 ry);
+	void drawEllipseUncached(uint8 color, bool hasAlpha, const Point *pt, int16 rx, int16 ry);
+	void drawSpan(int16 y, int16 x1, int16 x2, uint8 color, bool hasAlpha);
 	void fillArea(uint8 color, bool hasAlpha);
 	void drawSegment(uint8 color, bool hasAlpha, int16 ys, const Point *pts, uint8 numPts);
 	void drawPolygonOutline(uint8 color, const Point *pts, uint8 numPts);
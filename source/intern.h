@@ -167,7 +167,10 @@ struct CollisionSlot {
 
 struct BankSlot {
 	uint16 entryNum;
-	uint8 *ptr;
+	uint8 *ptr; // 0 if the slot is free
+	uint32 size;
+	uint32 lastUse; // the slot with the lowest value is evicted first
+	int16 hashNext;
 };
 
 struct CollisionSlot2 {
@@ -140,7 +140,7 @@ int main(int argc, char *argv[]) {
   consoleInit(GFX_BOTTOM, NULL);
   
 	g_debugMask = DBG_INFO; // DBG_CUT | DBG_VIDEO | DBG_RES | DBG_MENU | DBG_PGE | DBG_GAME | DBG_UNPACK | DBG_COL | DBG_MOD | DBG_SFX | DBG_FILE;
-	FileSystem fs(dataPath);
+	FileSystem fs(dataPath, savePath);
   
 	const int version = detectVersion(&fs);
 	if (version == -1)
@@ -157,7 +157,13 @@ int main(int argc, char *argv[]) {
   if (game == 0)
     waitForSelectAndQuit("Failed to allocate game!");
 
+#if defined(CUTSCENE_BENCHMARK)
+	game->benchmarkCutscenes();
+#elif defined(UNPACK_CACHE_PREWARM)
+	game->prewarmUnpackCache();
+#else
 	game->run();
+#endif
 	delete game;
 	delete stub;
 
@@ -15,26 +15,55 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <sys/stat.h>
 #include "file.h"
 #include "unpack.h"
 #include "resource.h"
 
+// budget of the decoded sprite banks cache
+#ifndef BANK_CACHE_SIZE
+#define BANK_CACHE_SIZE 0x7000
+#endif
 
-Resource::Resource(FileSystem *fs, ResourceType ver, Language lang) {
-	memset(this, 0, sizeof(Resource));
-	_type = ver;
-	_lang = lang;
-	_fs = fs;
+static const char *UNPACK_CACHE_DIR = "unpack";
+static const int UNPACK_CACHE_HEADER_SIZE = 12;
+
+
+Resource::Resource(FileSystem *fs, ResourceType ver, Language lang)
+	: _fs(fs), _type(ver), _lang(lang), _hasSeqData(false),
+	_fnt(0), _mbk(0), _icn(0), _icnLen(0), _tab(0), _spc(0), _numSpc(0), _pal(0), _ani(0), _tbn(0), _spr1(0),
+	_pgeNum(0), _map(0), _lev(0), _levNum(0), _sgd(0), _numObjectNodes(0), _memBuf(0),
+	_sfxList(0), _numSfx(0), _cmd(0), _pol(0), _polLen(0), _cmdLen(0), _unpackCachePath(0),
+	_cine_off(0), _cine_txt(0), _extTextsTable(0), _textsTable(0), _extStringsTable(0), _stringsTable(0),
+	_bankData(0), _bankDataHead(0), _bankDataTail(0), _bankDataUsed(0), _bankBuffersCount(0), _bankUseCounter(0),
+	_bankHits(0), _bankMisses(0), _bankEvictions(0), _bankCompactions(0), _bankUnpackTimeUs(0) {
+	memset(_entryName, 0, sizeof(_entryName));
+	memset(_rp, 0, sizeof(_rp));
+	memset(_ctData, 0, sizeof(_ctData));
+	memset(_spr_off, 0, sizeof(_spr_off));
+	memset(_sprm, 0, sizeof(_sprm));
+	memset(_pgeInit, 0, sizeof(_pgeInit));
+	memset(_levName, 0, sizeof(_levName));
+	memset(_objectNodesMap, 0, sizeof(_objectNodesMap));
+	memset(&_tbnView, 0, sizeof(_tbnView));
+	memset(&_mapView, 0, sizeof(_mapView));
+	memset(&_levView, 0, sizeof(_levView));
+	memset(&_cmdView, 0, sizeof(_cmdView));
+	memset(&_polView, 0, sizeof(_polView));
+	memset(_bankBuffers, 0, sizeof(_bankBuffers));
+	memset(_bankHash, 0, sizeof(_bankHash));
 	_memBuf = (uint8 *)malloc(256 * 224);
 	if (!_memBuf) {
 		error("Unable to allocate temporary memory buffer");
 	}
-	static const int kBankDataSize = 0x7000;
-	_bankData = (uint8 *)malloc(kBankDataSize);
+	_bankData = (uint8 *)malloc(BANK_CACHE_SIZE);
 	if (!_bankData) {
 		error("Unable to allocate bank data buffer");
 	}
-	_bankDataTail = _bankData + kBankDataSize;
+	_bankDataTail = _bankData + BANK_CACHE_SIZE;
 	clearBankData();
 }
 
@@ -47,10 +76,11 @@ Resource::~Resource() {
 	free(_spc);
 	free(_spr1);
 	free(_memBuf);
-	free(_cmd);
-	free(_pol);
+	_cmdView.release();
+	_polView.release();
 	free(_cine_off);
 	free(_cine_txt);
+	free(_unpackCachePath);
 	for (int i = 0; i < _numSfx; ++i) {
 		free(_sfxList[i].data);
 	}
@@ -58,15 +88,79 @@ Resource::~Resource() {
 }
 
 void Resource::clearLevelRes() {
-	free(_tbn); _tbn = 0;
-	free(_mbk); _mbk = 0;
-	free(_pal); _pal = 0;
-	free(_map); _map = 0;
-	free(_lev); _lev = 0;
+	_tbnView.release(); _tbn = 0;
+	_mbk = 0;
+	_pal = 0;
+	_mapView.release(); _map = 0;
+	_levView.release(); _lev = 0;
 	_levNum = -1;
-	free(_sgd); _sgd = 0;
-	free(_ani); _ani = 0;
+	_sgd = 0;
+	_ani = 0;
 	free_OBJ();
+	_levelArena.rewind();
+}
+
+// The cache is only used if its directory exists in the save directory.
+bool Resource::openUnpackCache(const char *savePath, bool create) {
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", savePath, UNPACK_CACHE_DIR);
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		if (!create) {
+			return false;
+		}
+#ifdef _WIN32
+		const int ret = _mkdir(path);
+#else
+		const int ret = mkdir(path, 0777);
+#endif
+		if (ret != 0) {
+			return false;
+		}
+	} else if (!S_ISDIR(st.st_mode)) {
+		return false;
+	}
+	free(_unpackCachePath);
+	_unpackCachePath = strdup(path);
+	debug(DBG_INFO, "Using the unpack cache '%s'", path);
+	return _unpackCachePath != 0;
+}
+
+// delphine_unpack() keeping a copy of the output in the unpack cache, 'name'
+// and 'offset' locate the packed data in the game files. A copy is used only
+// if it was made from data with the same CRC and size.
+bool Resource::unpack(uint8 *dst, const uint8 *src, int len, const char *name, uint32 offset) {
+	if (!_unpackCachePath) {
+		return delphine_unpack(dst, src, len);
+	}
+	const uint32 crc = READ_BE_UINT32(src + len - 8);
+	const uint32 size = READ_BE_UINT32(src + len - 4);
+	char cacheName[64];
+	snprintf(cacheName, sizeof(cacheName), "%s-%X.unp", name, offset);
+	File f;
+	if (f.open(cacheName, "rb", _unpackCachePath) && f.size() == UNPACK_CACHE_HEADER_SIZE + size) {
+		uint8 hdr[UNPACK_CACHE_HEADER_SIZE];
+		f.read(hdr, sizeof(hdr));
+		if (memcmp(hdr, "FBUC", 4) == 0 && READ_BE_UINT32(hdr + 4) == crc && READ_BE_UINT32(hdr + 8) == size) {
+			f.read(dst, size);
+			if (!f.ioErr()) {
+				return true;
+			}
+		}
+	}
+	if (!delphine_unpack(dst, src, len)) {
+		return false;
+	}
+	if (f.open(cacheName, "wb", _unpackCachePath)) {
+		f.write((void *)"FBUC", 4);
+		f.writeUint32BE(crc);
+		f.writeUint32BE(size);
+		f.write(dst, size);
+		if (f.ioErr()) {
+			warning("I/O error when writing '%s'", cacheName);
+		}
+	}
+	return true;
 }
 
 void Resource::load_FIB(const char *fileName) {
@@ -336,131 +430,142 @@ void Resource::free_TEXT() {
 
 void Resource::load(const char *objName, int objType, const char *ext) {
 	debug(DBG_RES, "Resource::load('%s', %d)", objName, objType);
+	char name[32]; // not _entryName, the level files are loaded from a thread
 	LoadStub loadStub = 0;
+	const char *mode = "rb";
 	switch (objType) {
 	case OT_MBK:
-		snprintf(_entryName, sizeof(_entryName), "%s.MBK", objName);
+		snprintf(name, sizeof(name), "%s.MBK", objName);
 		loadStub = &Resource::load_MBK;
 		break;
 	case OT_PGE:
-		snprintf(_entryName, sizeof(_entryName), "%s.PGE", objName);
+		snprintf(name, sizeof(name), "%s.PGE", objName);
 		loadStub = &Resource::load_PGE;
 		break;
 	case OT_PAL:
-		snprintf(_entryName, sizeof(_entryName), "%s.PAL", objName);
+		snprintf(name, sizeof(name), "%s.PAL", objName);
 		loadStub = &Resource::load_PAL;
 		break;
 	case OT_CT:
-		snprintf(_entryName, sizeof(_entryName), "%s.CT", objName);
+		snprintf(name, sizeof(name), "%s.CT", objName);
 		loadStub = &Resource::load_CT;
+		mode = "urb";
 		break;
 	case OT_MAP:
-		snprintf(_entryName, sizeof(_entryName), "%s.MAP", objName);
+		snprintf(name, sizeof(name), "%s.MAP", objName);
 		loadStub = &Resource::load_MAP;
 		break;
 	case OT_SPC:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPC", objName);
+		snprintf(name, sizeof(name), "%s.SPC", objName);
 		loadStub = &Resource::load_SPC;
 		break;
 	case OT_RP:
-		snprintf(_entryName, sizeof(_entryName), "%s.RP", objName);
+		snprintf(name, sizeof(name), "%s.RP", objName);
 		loadStub = &Resource::load_RP;
 		break;
 	case OT_RPC:
-		snprintf(_entryName, sizeof(_entryName), "%s.RPC", objName);
+		snprintf(name, sizeof(name), "%s.RPC", objName);
 		loadStub = &Resource::load_RP;
 		break;
 	case OT_SPR:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPR", objName);
+		snprintf(name, sizeof(name), "%s.SPR", objName);
 		loadStub = &Resource::load_SPR;
 		break;
 	case OT_SPRM:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPR", objName);
+		snprintf(name, sizeof(name), "%s.SPR", objName);
 		loadStub = &Resource::load_SPRM;
 		break;
 	case OT_ICN:
-		snprintf(_entryName, sizeof(_entryName), "%s.ICN", objName);
+		snprintf(name, sizeof(name), "%s.ICN", objName);
 		loadStub = &Resource::load_ICN;
 		break;
 	case OT_FNT:
-		snprintf(_entryName, sizeof(_entryName), "%s.FNT", objName);
+		snprintf(name, sizeof(name), "%s.FNT", objName);
 		loadStub = &Resource::load_FNT;
 		break;
 	case OT_OBJ:
-		snprintf(_entryName, sizeof(_entryName), "%s.OBJ", objName);
+		snprintf(name, sizeof(name), "%s.OBJ", objName);
 		loadStub = &Resource::load_OBJ;
 		break;
 	case OT_ANI:
-		snprintf(_entryName, sizeof(_entryName), "%s.ANI", objName);
+		snprintf(name, sizeof(name), "%s.ANI", objName);
 		loadStub = &Resource::load_ANI;
 		break;
 	case OT_TBN:
-		snprintf(_entryName, sizeof(_entryName), "%s.TBN", objName);
+		snprintf(name, sizeof(name), "%s.TBN", objName);
 		loadStub = &Resource::load_TBN;
 		break;
 	case OT_CMD:
-		snprintf(_entryName, sizeof(_entryName), "%s.CMD", objName);
+		snprintf(name, sizeof(name), "%s.CMD", objName);
 		loadStub = &Resource::load_CMD;
 		break;
 	case OT_POL:
-		snprintf(_entryName, sizeof(_entryName), "%s.POL", objName);
+		snprintf(name, sizeof(name), "%s.POL", objName);
 		loadStub = &Resource::load_POL;
 		break;
 	case OT_CMP:
-		snprintf(_entryName, sizeof(_entryName), "%s.CMP", objName);
+		snprintf(name, sizeof(name), "%s.CMP", objName);
 		loadStub = &Resource::load_CMP;
 		break;
 	case OT_OBC:
-		snprintf(_entryName, sizeof(_entryName), "%s.OBC", objName);
+		snprintf(name, sizeof(name), "%s.OBC", objName);
 		loadStub = &Resource::load_OBC;
 		break;
 	case OT_SPL:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPL", objName);
+		snprintf(name, sizeof(name), "%s.SPL", objName);
 		loadStub = &Resource::load_SPL;
 		break;
 	case OT_LEV:
-		snprintf(_entryName, sizeof(_entryName), "%s.LEV", objName);
+		snprintf(name, sizeof(name), "%s.LEV", objName);
 		loadStub = &Resource::load_LEV;
 		break;
 	case OT_SGD:
-		snprintf(_entryName, sizeof(_entryName), "%s.SGD", objName);
+		snprintf(name, sizeof(name), "%s.SGD", objName);
 		loadStub = &Resource::load_SGD;
+		mode = "urb";
 		break;
 	case OT_SPM:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPM", objName);
+		snprintf(name, sizeof(name), "%s.SPM", objName);
 		loadStub = &Resource::load_SPM;
+		mode = "urb";
 		break;
 	default:
 		error("Unimplemented Resource::load() type %d", objType);
 		break;
 	}
 	if (ext) {
-		snprintf(_entryName, sizeof(_entryName), "%s.%s", objName, ext);
+		snprintf(name, sizeof(name), "%s.%s", objName, ext);
 	}
 	File f;
-	if (f.open(_entryName, "rb", _fs)) {
+	if (f.open(name, mode, _fs)) {
 		assert(loadStub);
 		(this->*loadStub)(&f);
 		if (f.ioErr()) {
-			error("I/O error when reading '%s'", _entryName);
+			error("I/O error when reading '%s'", name);
 		}
 	} else {
-		error("Can't open '%s'", _entryName);
+		error("Can't open '%s'", name);
 	}
 }
 
 void Resource::load_CT(File *pf) {
 	debug(DBG_RES, "Resource::load_CT()");
 	int len = pf->size();
-	uint8 *tmp = (uint8 *)malloc(len);
-	if (!tmp) {
+	if (pf->isUnpacked()) {
+		if (len != sizeof(_ctData)) {
+			error("Bad size for unpacked collision data");
+		}
+		pf->read(_ctData, len);
+		return;
+	}
+	FileView tmp;
+	if (!pf->map(&tmp)) {
 		error("Unable to allocate CT buffer");
 	} else {
-		pf->read(tmp, len);
-		if (!delphine_unpack((uint8 *)_ctData, tmp, len)) {
+		if (!unpack((uint8 *)_ctData, tmp.data, len, pf->_name, 0)) {
 			error("Bad CRC for collision data");
 		}
-		free(tmp);
+		tmp.release();
 	}
 }
 
@@ -478,7 +583,7 @@ void Resource::load_FNT(File *f) {
 void Resource::load_MBK(File *f) {
 	debug(DBG_RES, "Resource::load_MBK()");
 	int len = f->size();
-	_mbk = (uint8 *)malloc(len);
+	_mbk = (uint8 *)_levelArena.allocate(len);
 	if (!_mbk) {
 		error("Unable to allocate MBK buffer");
 	} else {
@@ -541,7 +646,7 @@ void Resource::load_SPC(File *f) {
 void Resource::load_PAL(File *f) {
 	debug(DBG_RES, "Resource::load_PAL()");
 	int len = f->size();
-	_pal = (uint8 *)malloc(len);
+	_pal = (uint8 *)_levelArena.allocate(len);
 	if (!_pal) {
 		error("Unable to allocate PAL buffer");
 	} else {
@@ -551,13 +656,10 @@ void Resource::load_PAL(File *f) {
 
 void Resource::load_MAP(File *f) {
 	debug(DBG_RES, "Resource::load_MAP()");
-	int len = f->size();
-	_map = (uint8 *)malloc(len);
-	if (!_map) {
+	if (!f->map(&_mapView)) {
 		error("Unable to allocate MAP buffer");
-	} else {
-		f->read(_map, len);
 	}
+	_map = _mapView.data;
 }
 
 void Resource::load_OBJ(File *f) {
@@ -584,7 +686,7 @@ void Resource::load_OBJ(File *f) {
 	int iObj = 0;
 	for (int i = 0; i < _numObjectNodes; ++i) {
 		if (prevOffset != offsets[i]) {
-			ObjectNode *on = (ObjectNode *)malloc(sizeof(ObjectNode));
+			ObjectNode *on = (ObjectNode *)_levelArena.allocate(sizeof(ObjectNode));
 			if (!on) {
 				error("Unable to allocate ObjectNode num=%d", i);
 			}
@@ -592,21 +694,23 @@ void Resource::load_OBJ(File *f) {
 			on->last_obj_number = f->readUint16LE();
 			on->num_objects = objectsCount[iObj];
 			debug(DBG_RES, "last=%d num=%d", on->last_obj_number, on->num_objects);
-			on->objects = (Object *)malloc(sizeof(Object) * on->num_objects);
+			on->objects = (Object *)_levelArena.allocate(sizeof(Object) * on->num_objects);
 			for (int j = 0; j < on->num_objects; ++j) {
+				uint8 buf[0x12];
+				f->read(buf, sizeof(buf));
 				Object *obj = &on->objects[j];
-				obj->type = f->readUint16LE();
-				obj->dx = f->readByte();
-				obj->dy = f->readByte();
-				obj->init_obj_type = f->readUint16LE();
-				obj->opcode2 = f->readByte();
-				obj->opcode1 = f->readByte();
-				obj->flags = f->readByte();
-				obj->opcode3 = f->readByte();
-				obj->init_obj_number = f->readUint16LE();
-				obj->opcode_arg1 = f->readUint16LE();
-				obj->opcode_arg2 = f->readUint16LE();
-				obj->opcode_arg3 = f->readUint16LE();
+				obj->type = READ_LE_UINT16(buf);
+				obj->dx = buf[2];
+				obj->dy = buf[3];
+				obj->init_obj_type = READ_LE_UINT16(buf + 4);
+				obj->opcode2 = buf[6];
+				obj->opcode1 = buf[7];
+				obj->flags = buf[8];
+				obj->opcode3 = buf[9];
+				obj->init_obj_number = READ_LE_UINT16(buf + 10);
+				obj->opcode_arg1 = READ_LE_UINT16(buf + 12);
+				obj->opcode_arg2 = READ_LE_UINT16(buf + 14);
+				obj->opcode_arg3 = READ_LE_UINT16(buf + 16);
 				debug(DBG_RES, "obj_node=%d obj=%d op1=0x%X op2=0x%X op3=0x%X", i, j, obj->opcode2, obj->opcode1, obj->opcode3);
 			}
 			++iObj;
@@ -617,18 +721,10 @@ void Resource::load_OBJ(File *f) {
 	}
 }
 
+// the nodes are allocated from _levelArena, released by clearLevelRes()
 void Resource::free_OBJ() {
 	debug(DBG_RES, "Resource::free_OBJ()");
-	ObjectNode *prevNode = 0;
-	for (int i = 0; i < _numObjectNodes; ++i) {
-		if (_objectNodesMap[i] != prevNode) {
-			ObjectNode *curNode = _objectNodesMap[i];
-			free(curNode->objects);
-			free(curNode);
-			prevNode = curNode;
-		}
-		_objectNodesMap[i] = 0;
-	}
+	memset(_objectNodesMap, 0, sizeof(_objectNodesMap));
 }
 
 void Resource::load_OBC(File *f) {
@@ -645,7 +741,7 @@ void Resource::load_OBC(File *f) {
 	}
 	f->seek(4);
 	f->read(packedData, packedSize);
-	if (!delphine_unpack(tmp, packedData, packedSize)) {
+	if (!unpack(tmp, packedData, packedSize, f->_name, 4)) {
 		error("Bad CRC for compressed object data");
 	}
 	free(packedData);
@@ -670,14 +766,14 @@ void Resource::load_OBC(File *f) {
 	int iObj = 0;
 	for (int i = 0; i < _numObjectNodes; ++i) {
 		if (prevOffset != offsets[i]) {
-			ObjectNode *on = (ObjectNode *)malloc(sizeof(ObjectNode));
+			ObjectNode *on = (ObjectNode *)_levelArena.allocate(sizeof(ObjectNode));
 			if (!on) {
 				error("Unable to allocate ObjectNode num=%d", i);
 			}
 			const uint8 *objData = tmp + offsets[i];
 			on->last_obj_number = READ_BE_UINT16(objData); objData += 2;
 			on->num_objects = objectsCount[iObj];
-			on->objects = (Object *)malloc(sizeof(Object) * on->num_objects);
+			on->objects = (Object *)_levelArena.allocate(sizeof(Object) * on->num_objects);
 			for (int j = 0; j < on->num_objects; ++j) {
 				Object *obj = &on->objects[j];
 				obj->type = READ_BE_UINT16(objData); objData += 2;
@@ -712,50 +808,39 @@ void Resource::load_PGE(File *f) {
 	}
 	memset(_pgeInit, 0, sizeof(_pgeInit));
 	debug(DBG_RES, "len=%d _pgeNum=%d", len, _pgeNum);
+	// the Amiga data is big endian
+	uint16 (*readUint16)(const void *) = (_type == kResourceTypeAmiga) ? READ_BE_UINT16 : READ_LE_UINT16;
 	for (uint16 i = 0; i < _pgeNum; ++i) {
+		uint8 buf[0x20];
+		f->read(buf, sizeof(buf));
 		InitPGE *pge = &_pgeInit[i];
-		pge->type = f->readUint16LE();
-		pge->pos_x = f->readUint16LE();
-		pge->pos_y = f->readUint16LE();
-		pge->obj_node_number = f->readUint16LE();
-		pge->life = f->readUint16LE();
+		pge->type = readUint16(buf);
+		pge->pos_x = readUint16(buf + 2);
+		pge->pos_y = readUint16(buf + 4);
+		pge->obj_node_number = readUint16(buf + 6);
+		pge->life = readUint16(buf + 8);
 		for (int lc = 0; lc < 4; ++lc) {
-			pge->counter_values[lc] = f->readUint16LE();
-		}
-		pge->object_type = f->readByte();
-		pge->init_room = f->readByte();
-		pge->room_location = f->readByte();
-		pge->init_flags = f->readByte();
-		pge->colliding_icon_num = f->readByte();
-		pge->icon_num = f->readByte();
-		pge->object_id = f->readByte();
-		pge->skill = f->readByte();
-		pge->mirror_x = f->readByte();
-		pge->flags = f->readByte();
-		pge->unk1C = f->readByte();
-		f->readByte();
-		pge->text_num = f->readUint16LE();
-	}
-	if (_type == kResourceTypeAmiga) {
-		for (uint16 i = 0; i < _pgeNum; ++i) {
-			InitPGE *pge = &_pgeInit[i];
-			SWAP_UINT16((uint16 *)&pge->type);
-			SWAP_UINT16((uint16 *)&pge->pos_x);
-			SWAP_UINT16((uint16 *)&pge->pos_y);
-			SWAP_UINT16((uint16 *)&pge->obj_node_number);
-			SWAP_UINT16((uint16 *)&pge->life);
-			for (int lc = 0; lc < 4; ++lc) {
-				SWAP_UINT16((uint16 *)&pge->counter_values[lc]);
-			}
-			SWAP_UINT16((uint16 *)&pge->text_num);
+			pge->counter_values[lc] = readUint16(buf + 10 + lc * 2);
 		}
+		pge->object_type = buf[18];
+		pge->init_room = buf[19];
+		pge->room_location = buf[20];
+		pge->init_flags = buf[21];
+		pge->colliding_icon_num = buf[22];
+		pge->icon_num = buf[23];
+		pge->object_id = buf[24];
+		pge->skill = buf[25];
+		pge->mirror_x = buf[26];
+		pge->flags = buf[27];
+		pge->unk1C = buf[28];
+		pge->text_num = readUint16(buf + 30);
 	}
 }
 
 void Resource::load_ANI(File *f) {
 	debug(DBG_RES, "Resource::load_ANI()");
 	int size = f->size() - 2;
-	_ani = (uint8 *)malloc(size);
+	_ani = (uint8 *)_levelArena.allocate(size);
 	if (!_ani) {
 		error("Unable to allocate ANI buffer");
 	} else {
@@ -791,13 +876,11 @@ void Resource::load_ANI(File *f) {
 
 void Resource::load_TBN(File *f) {
 	debug(DBG_RES, "Resource::load_TBN()");
-	int len = f->size();
-	_tbn = (uint8 *)malloc(len);
-	if (!_tbn) {
+	// the Amiga offsets are swapped in place
+	if (!f->map(&_tbnView, _type == kResourceTypeAmiga)) {
 		error("Unable to allocate TBN buffer");
-	} else {
-		f->read(_tbn, len);
 	}
+	_tbn = _tbnView.data;
 	if (_type == kResourceTypeAmiga) {
 		const int firstOffset = READ_BE_UINT16(_tbn);
 		for (int i = 0; i < firstOffset; i += 2) {
@@ -809,37 +892,36 @@ void Resource::load_TBN(File *f) {
 
 void Resource::load_CMD(File *pf) {
 	debug(DBG_RES, "Resource::load_CMD()");
-	free(_cmd);
-	int len = pf->size();
-	_cmd = (uint8 *)malloc(len);
-	if (!_cmd) {
+	_cmdView.release();
+	_cmd = 0;
+	_cmdLen = 0;
+	if (!pf->map(&_cmdView)) {
 		error("Unable to allocate CMD buffer");
-	} else {
-		pf->read(_cmd, len);
 	}
+	_cmd = _cmdView.data;
+	_cmdLen = _cmdView.size;
 }
 
 void Resource::load_POL(File *pf) {
 	debug(DBG_RES, "Resource::load_POL()");
-	free(_pol);
-	int len = pf->size();
-	_pol = (uint8 *)malloc(len);
-	if (!_pol) {
+	_polView.release();
+	_pol = 0;
+	_polLen = 0;
+	if (!pf->map(&_polView)) {
 		error("Unable to allocate POL buffer");
-	} else {
-		pf->read(_pol, len);
 	}
+	_pol = _polView.data;
+	_polLen = _polView.size;
 }
 
 void Resource::load_CMP(File *pf) {
-	free(_pol);
-	free(_cmd);
-	int len = pf->size();
-	uint8 *tmp = (uint8 *)malloc(len);
-	if (!tmp) {
+	_polView.release();
+	_cmdView.release();
+	FileView cmp;
+	if (!pf->map(&cmp)) {
 		error("Unable to allocate CMP buffer");
 	}
-	pf->read(tmp, len);
+	const uint8 *tmp = cmp.data;
 	struct {
 		int offset, packedSize, size;
 	} data[2];
@@ -856,25 +938,27 @@ void Resource::load_CMP(File *pf) {
 		data[i].packedSize = packedSize;
 		offset += packedSize;
 	}
-	_pol = (uint8 *)malloc(data[0].size);
-	if (!_pol) {
+	if (!_polView.alloc(data[0].size)) {
 		error("Unable to allocate POL buffer");
 	}
+	_pol = _polView.data;
+	_polLen = data[0].size;
 	if (data[0].packedSize == data[0].size) {
 		memcpy(_pol, tmp + data[0].offset, data[0].packedSize);
-	} else if (!delphine_unpack(_pol, tmp + data[0].offset, data[0].packedSize)) {
+	} else if (!unpack(_pol, tmp + data[0].offset, data[0].packedSize, pf->_name, data[0].offset)) {
 		error("Bad CRC for cutscene polygon data");
 	}
-	_cmd = (uint8 *)malloc(data[1].size);
-	if (!_cmd) {
+	if (!_cmdView.alloc(data[1].size)) {
 		error("Unable to allocate CMD buffer");
 	}
+	_cmd = _cmdView.data;
+	_cmdLen = data[1].size;
 	if (data[1].packedSize == data[1].size) {
 		memcpy(_cmd, tmp + data[1].offset, data[1].packedSize);
-	} else if (!delphine_unpack(_cmd, tmp + data[1].offset, data[1].packedSize)) {
+	} else if (!unpack(_cmd, tmp + data[1].offset, data[1].packedSize, pf->_name, data[1].offset)) {
 		error("Bad CRC for cutscene command data");
 	}
-	free(tmp);
+	cmp.release();
 }
 
 void Resource::load_VCE(int num, int segment, uint8 **buf, uint32 *bufSize) {
@@ -897,14 +981,15 @@ void Resource::load_VCE(int num, int segment, uint8 **buf, uint32 *bufSize) {
 						for (int i = 0; i < len / (0x2000 + 2048); ++i) {
 							if (s == segment) {
 								f.seek(offset);
-								int n = 2048;
-								while (n--) {
-									int v = f.readByte();
+								f.read(dst, 2048);
+								for (int n = 0; n < 2048; ++n) {
+									int v = dst[n];
 									if (v & 0x80) {
 										v = -(v & 0x7F);
 									}
-									*dst++ = (uint8)(v & 0xFF);
+									dst[n] = (uint8)(v & 0xFF);
 								}
+								dst += 2048;
 							}
 							offset += 0x2000 + 2048;
 						}
@@ -952,46 +1037,52 @@ void Resource::load_SPL(File *f) {
 }
 
 void Resource::load_LEV(File *f) {
-	const int len = f->size();
-	_lev = (uint8 *)malloc(len);
-	if (!_lev) {
+	if (!f->map(&_levView)) {
 		error("Unable to allocate LEV buffer");
-	} else {
-		f->read(_lev, len);
 	}
+	_lev = _levView.data;
+	snprintf(_levName, sizeof(_levName), "%s", f->_name);
 }
 
 void Resource::load_SGD(File *f) {
 	const int len = f->size();
+	if (f->isUnpacked()) {
+		_sgd = (uint8 *)_levelArena.allocate(len);
+		if (!_sgd) {
+			error("Unable to allocate SGD buffer");
+		}
+		f->read(_sgd, len);
+		return;
+	}
 	f->seek(len - 4);
 	int size = f->readUint32BE();
-	f->seek(0);
-	uint8 *tmp = (uint8 *)malloc(len);
-	if (!tmp) {
+	FileView tmp;
+	if (!f->map(&tmp)) {
 		error("Unable to allocate SGD temporary buffer");
 	}
-	f->read(tmp, len);
-	_sgd = (uint8 *)malloc(size);
+	_sgd = (uint8 *)_levelArena.allocate(size);
 	if (!_sgd) {
 		error("Unable to allocate SGD buffer");
 	}
-	if (!delphine_unpack(_sgd, tmp, len)) {
+	if (!unpack(_sgd, tmp.data, len, f->_name, 0)) {
 		error("Bad CRC for SGD data");
 	}
-	free(tmp);
+	tmp.release();
 }
 
 void Resource::load_SPM(File *f) {
 	static const int kPersoDatSize = 178647;
 	const int len = f->size();
-	f->seek(len - 4);
-	int size = f->readUint32BE();
-	f->seek(0);
-	uint8 *tmp = (uint8 *)malloc(len);
-	if (!tmp) {
-		error("Unable to allocate SPM temporary buffer");
+	int size = len;
+	FileView tmp;
+	tmp.data = 0;
+	if (!f->isUnpacked()) {
+		f->seek(len - 4);
+		size = f->readUint32BE();
+		if (!f->map(&tmp)) {
+			error("Unable to allocate SPM temporary buffer");
+		}
 	}
-	f->read(tmp, len);
 	int sprOffset = 0;
 	if (size == kPersoDatSize) {
 		_spr1 = (uint8 *)malloc(size);
@@ -1002,18 +1093,33 @@ void Resource::load_SPM(File *f) {
 	if (!_spr1) {
 		error("Unable to allocate SPM buffer");
 	}
-	if (!delphine_unpack(_spr1 + sprOffset, tmp, len)) {
-		error("Bad CRC for SPM data");
+	if (!tmp.data) {
+		f->read(_spr1 + sprOffset, size);
+	} else {
+		if (!unpack(_spr1 + sprOffset, tmp.data, len, f->_name, 0)) {
+			error("Bad CRC for SPM data");
+		}
+		tmp.release();
 	}
-	free(tmp);
 	for (int i = 0; i < 1287; ++i) {
 		_spr_off[i] = _spr1 + _spmOffsetsTable[i];
 	}
 }
 
 void Resource::clearBankData() {
+	if (_bankHits + _bankMisses != 0) {
+		debug(DBG_INFO, "Bank cache: %d hits, %d misses, %d evictions, %d compactions, unpacked in %d ms", _bankHits, _bankMisses, _bankEvictions, _bankCompactions, _bankUnpackTimeUs / 1000);
+	}
+	for (int i = 0; i < BANK_SLOTS; ++i) {
+		_bankBuffers[i].ptr = 0;
+	}
+	memset(_bankHash, 0xFF, sizeof(_bankHash));
 	_bankBuffersCount = 0;
 	_bankDataHead = _bankData;
+	_bankDataUsed = 0;
+	_bankUseCounter = 0;
+	_bankHits = _bankMisses = _bankEvictions = _bankCompactions = 0;
+	_bankUnpackTimeUs = 0;
 }
 
 int Resource::getBankDataSize(uint16 num) {
@@ -1034,14 +1140,69 @@ int Resource::getBankDataSize(uint16 num) {
 }
 
 uint8 *Resource::findBankData(uint16 num) {
-	for (int i = 0; i < _bankBuffersCount; ++i) {
-		if (_bankBuffers[i].entryNum == num) {
-			return _bankBuffers[i].ptr;
+	for (int i = _bankHash[num & (BANK_HASH_SIZE - 1)]; i != -1; i = _bankBuffers[i].hashNext) {
+		BankSlot *slot = &_bankBuffers[i];
+		if (slot->entryNum == num) {
+			slot->lastUse = ++_bankUseCounter;
+			++_bankHits;
+			return slot->ptr;
 		}
 	}
 	return 0;
 }
 
+// Removes the least recently used bank from the cache.
+void Resource::evictBankData() {
+	int lru = -1;
+	for (int i = 0; i < BANK_SLOTS; ++i) {
+		if (_bankBuffers[i].ptr && (lru < 0 || _bankBuffers[i].lastUse < _bankBuffers[lru].lastUse)) {
+			lru = i;
+		}
+	}
+	assert(lru >= 0);
+	BankSlot *slot = &_bankBuffers[lru];
+	int16 *prev = &_bankHash[slot->entryNum & (BANK_HASH_SIZE - 1)];
+	while (*prev != lru) {
+		prev = &_bankBuffers[*prev].hashNext;
+	}
+	*prev = slot->hashNext;
+	if (slot->ptr + slot->size == _bankDataHead) {
+		_bankDataHead = slot->ptr;
+	}
+	_bankDataUsed -= slot->size;
+	slot->ptr = 0;
+	--_bankBuffersCount;
+	++_bankEvictions;
+}
+
+// Moves the cached banks to the start of the buffer, in the same order, to
+// merge the holes left by the evicted ones.
+void Resource::compactBankData() {
+	int order[BANK_SLOTS];
+	int count = 0;
+	for (int i = 0; i < BANK_SLOTS; ++i) {
+		if (_bankBuffers[i].ptr) {
+			int j = count++;
+			for (; j > 0 && _bankBuffers[order[j - 1]].ptr > _bankBuffers[i].ptr; --j) {
+				order[j] = order[j - 1];
+			}
+			order[j] = i;
+		}
+	}
+	_bankDataHead = _bankData;
+	for (int i = 0; i < count; ++i) {
+		BankSlot *slot = &_bankBuffers[order[i]];
+		if (slot->ptr != _bankDataHead) {
+			memmove(_bankDataHead, slot->ptr, slot->size);
+			slot->ptr = _bankDataHead;
+		}
+		_bankDataHead += slot->size;
+	}
+	++_bankCompactions;
+}
+
+// The returned pointer, like the ones from findBankData(), is valid until the
+// next call to loadBankData().
 uint8 *Resource::loadBankData(uint16 num) {
 	const uint8 *ptr = _mbk + num * 6;
 	int dataOffset = READ_BE_UINT32(ptr);
@@ -1050,24 +1211,41 @@ uint8 *Resource::loadBankData(uint16 num) {
 		// to the total count of entries
 		dataOffset &= 0xFFFF;
 	}
-	const int size = getBankDataSize(num);
-	const int avail = _bankDataTail - _bankDataHead;
-	if (avail < size) {
-		clearBankData();
-	}
-	assert(_bankDataHead + size <= _bankDataTail);
-	assert(_bankBuffersCount < (int)ARRAYSIZE(_bankBuffers));
-	_bankBuffers[_bankBuffersCount].entryNum = num;
-	_bankBuffers[_bankBuffersCount].ptr = _bankDataHead;
+	const uint32 size = getBankDataSize(num);
+	if (size > (uint32)(_bankDataTail - _bankData)) {
+		error("Bank data %d does not fit in the cache, %d bytes", num, size);
+	}
+	++_bankMisses;
+	while (_bankBuffersCount == BANK_SLOTS || _bankDataUsed + size > (uint32)(_bankDataTail - _bankData)) {
+		evictBankData();
+	}
+	if (_bankDataHead + size > _bankDataTail) {
+		compactBankData();
+	}
+	int i = 0;
+	while (_bankBuffers[i].ptr) {
+		++i;
+	}
+	BankSlot *slot = &_bankBuffers[i];
+	slot->entryNum = num;
+	slot->ptr = _bankDataHead;
+	slot->size = size;
+	slot->lastUse = ++_bankUseCounter;
+	slot->hashNext = _bankHash[num & (BANK_HASH_SIZE - 1)];
+	_bankHash[num & (BANK_HASH_SIZE - 1)] = i;
+	++_bankBuffersCount;
+	_bankDataUsed += size;
 	const uint8 *data = _mbk + dataOffset;
 	if (READ_BE_UINT16(ptr + 4) & 0x8000) {
 		memcpy(_bankDataHead, data, size);
 	} else {
 		assert(dataOffset > 4);
-		assert(size == (int)READ_BE_UINT32(data - 4));
-		if (!delphine_unpack(_bankDataHead, data, 0)) {
+		assert(size == READ_BE_UINT32(data - 4));
+		const uint32 startUs = getTimeStampUs();
+		if (!delphine_unpack(_bankDataHead, _mbk, dataOffset)) {
 			error("Bad CRC for bank data %d", num);
 		}
+		_bankUnpackTimeUs += getTimeStampUs() - startUs;
 	}
 	uint8 *bankData = _bankDataHead;
 	_bankDataHead += size;
@@ -19,8 +19,9 @@
 #define RESOURCE_H__
 
 #include "intern.h"
+#include "arena.h"
+#include "file.h"
 
-struct File;
 struct FileSystem;
 
 struct LocaleData {
@@ -64,6 +65,11 @@ struct LocaleData {
 struct Resource {
 	typedef void (Resource::*LoadStub)(File *);
 
+	enum {
+		BANK_SLOTS = 64,
+		BANK_HASH_SIZE = 64
+	};
+
 	enum ObjectType {
 		OT_MBK,
 		OT_PGE,
@@ -122,14 +128,20 @@ struct Resource {
 	uint8 *_map;
 	uint8 *_lev;
 	int _levNum;
+	char _levName[32];
 	uint8 *_sgd;
 	uint16 _numObjectNodes;
 	ObjectNode *_objectNodesMap[255];
 	uint8 *_memBuf;
+	Arena _levelArena; // MBK, PAL, ANI, SGD and the objects of the current level
 	SoundFx *_sfxList;
 	uint8 _numSfx;
 	uint8 *_cmd;
 	uint8 *_pol;
+	int _polLen;
+	int _cmdLen;
+	FileView _tbnView, _mapView, _levView, _cmdView, _polView; // storage of the buffers above, possibly mapped
+	char *_unpackCachePath; // directory of the decompressed data, 0 if not used
 	uint8 *_cine_off;
 	uint8 *_cine_txt;
 	char **_extTextsTable;
@@ -139,13 +151,20 @@ struct Resource {
 	uint8 *_bankData;
 	uint8 *_bankDataHead;
 	uint8 *_bankDataTail;
-	BankSlot _bankBuffers[50];
+	uint32 _bankDataUsed; // size of the cached banks, the evicted ones leave holes below _bankDataHead
+	BankSlot _bankBuffers[BANK_SLOTS];
+	int16 _bankHash[BANK_HASH_SIZE]; // first slot of the entries with the same low bits, -1 if none
 	int _bankBuffersCount;
+	uint32 _bankUseCounter;
+	uint32 _bankHits, _bankMisses, _bankEvictions, _bankCompactions;
+	uint32 _bankUnpackTimeUs;
 
 	Resource(FileSystem *fs, ResourceType type, Language lang);
 	~Resource();
 
 	void clearLevelRes();
+	bool openUnpackCache(const char *savePath, bool create);
+	bool unpack(uint8 *dst, const uint8 *src, int len, const char *name, uint32 offset);
 	void load_FIB(const char *fileName);
 	void load_MAP_menu(const char *fileName, uint8 *dstPtr);
 	void load_PAL_menu(const char *fileName, uint8 *dstPtr);
@@ -199,6 +218,8 @@ struct Resource {
 	int getBankDataSize(uint16 num);
 	uint8 *findBankData(uint16 num);
 	uint8 *loadBankData(uint16 num);
+	void evictBankData();
+	void compactBankData();
 };
 
 #endif // RESOURCE_H__
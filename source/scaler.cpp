@@ -23,7 +23,9 @@ const Scaler _scalers[] = {
 	{ "point2x", &point2x, 2 },
 	{ "scale2x", &scale2x, 2 },
 	{ "point3x", &point3x, 3 },
-	{ "scale3x", &scale3x, 3 }
+	{ "scale3x", &scale3x, 3 },
+	{ "scale2x-fast", &scale2x_fast, 2 },
+	{ "scale3x-fast", &scale3x_fast, 3 }
 };
 
 void point1x(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h) {
@@ -139,3 +141,184 @@ void scale3x(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, u
 		src += srcPitch;
 	}
 }
+
+typedef uint16 uint16x8 __attribute__((vector_size(16)));
+
+static inline uint16x8 load8(const uint16 *p) {
+	uint16x8 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store8(uint16 *p, uint16x8 v) {
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline uint16x8 select8(uint16x8 m, uint16x8 a, uint16x8 b) {
+	return (a & m) | (b & ~m);
+}
+
+static inline void scale2xPixel(uint16 *p, int dstPitch, uint16 B, uint16 D, uint16 E, uint16 F, uint16 H) {
+	if (B != H && D != F) {
+		*(p) = D == B ? D : E;
+		*(p + 1) = B == F ? F : E;
+		*(p + dstPitch) = D == H ? D : E;
+		*(p + dstPitch + 1) = H == F ? F : E;
+	} else {
+		*(p) = E;
+		*(p + 1) = E;
+		*(p + dstPitch) = E;
+		*(p + dstPitch + 1) = E;
+	}
+}
+
+static inline void scale3xPixel(uint16 *p, int dstPitch, uint16 A, uint16 B, uint16 C, uint16 D, uint16 E, uint16 F, uint16 G, uint16 H, uint16 I) {
+	if (B != H && D != F) {
+		*(p) = D == B ? D : E;
+		*(p + 1) = (D == B && E != C) || (B == F && E != A) ? B : E;
+		*(p + 2) = B == F ? F : E;
+		*(p + dstPitch) = (D == B && E != G) || (D == B && E != A) ? D : E;
+		*(p + dstPitch + 1) = E;
+		*(p + dstPitch + 2) = (B == F && E != I) || (H == F && E != C) ? F : E;
+		*(p + 2 * dstPitch) = D == H ? D : E;
+		*(p + 2 * dstPitch + 1) = (D == H && E != I) || (H == F && E != G) ? H : E;
+		*(p + 2 * dstPitch + 2) = H == F ? F : E;
+	} else {
+		*(p) = E;
+		*(p + 1) = E;
+		*(p + 2) = E;
+		*(p + dstPitch) = E;
+		*(p + dstPitch + 1) = E;
+		*(p + dstPitch + 2) = E;
+		*(p + 2 * dstPitch) = E;
+		*(p + 2 * dstPitch + 1) = E;
+		*(p + 2 * dstPitch + 2) = E;
+	}
+}
+
+// scales pixels [x, end) of a row, the neighbours at x - 1 and end must be readable
+static void scale2xRow(uint16 *dst, int dstPitch, const uint16 *up, const uint16 *cur, const uint16 *down, int x, int end) {
+	static const uint16x8 lo = { 0, 8, 1, 9, 2, 10, 3, 11 };
+	static const uint16x8 hi = { 4, 12, 5, 13, 6, 14, 7, 15 };
+	for (; x + 8 <= end; x += 8) {
+		const uint16x8 B = load8(up + x);
+		const uint16x8 D = load8(cur + x - 1);
+		const uint16x8 E = load8(cur + x);
+		const uint16x8 F = load8(cur + x + 1);
+		const uint16x8 H = load8(down + x);
+		const uint16x8 m = (uint16x8)(B != H) & (uint16x8)(D != F);
+		const uint16x8 e0 = select8(m & (uint16x8)(D == B), D, E);
+		const uint16x8 e1 = select8(m & (uint16x8)(B == F), F, E);
+		const uint16x8 e2 = select8(m & (uint16x8)(D == H), D, E);
+		const uint16x8 e3 = select8(m & (uint16x8)(H == F), F, E);
+		uint16 *p = dst + x * 2;
+		store8(p, __builtin_shuffle(e0, e1, lo));
+		store8(p + 8, __builtin_shuffle(e0, e1, hi));
+		store8(p + dstPitch, __builtin_shuffle(e2, e3, lo));
+		store8(p + dstPitch + 8, __builtin_shuffle(e2, e3, hi));
+	}
+	for (; x < end; ++x) {
+		scale2xPixel(dst + x * 2, dstPitch, up[x], cur[x - 1], cur[x], cur[x + 1], down[x]);
+	}
+}
+
+static void scale3xRow(uint16 *dst, int dstPitch, const uint16 *up, const uint16 *cur, const uint16 *down, int x, int end) {
+	for (; x + 8 <= end; x += 8) {
+		const uint16x8 A = load8(up + x - 1);
+		const uint16x8 B = load8(up + x);
+		const uint16x8 C = load8(up + x + 1);
+		const uint16x8 D = load8(cur + x - 1);
+		const uint16x8 E = load8(cur + x);
+		const uint16x8 F = load8(cur + x + 1);
+		const uint16x8 G = load8(down + x - 1);
+		const uint16x8 H = load8(down + x);
+		const uint16x8 I = load8(down + x + 1);
+		const uint16x8 m = (uint16x8)(B != H) & (uint16x8)(D != F);
+		const uint16x8 DB = m & (uint16x8)(D == B);
+		const uint16x8 BF = m & (uint16x8)(B == F);
+		const uint16x8 DH = m & (uint16x8)(D == H);
+		const uint16x8 HF = m & (uint16x8)(H == F);
+		const uint16x8 EA = (uint16x8)(E != A);
+		const uint16x8 EC = (uint16x8)(E != C);
+		const uint16x8 EG = (uint16x8)(E != G);
+		const uint16x8 EI = (uint16x8)(E != I);
+		uint16x8 e[9];
+		e[0] = select8(DB, D, E);
+		e[1] = select8((DB & EC) | (BF & EA), B, E);
+		e[2] = select8(BF, F, E);
+		e[3] = select8((DB & EG) | (DB & EA), D, E);
+		e[4] = E;
+		e[5] = select8((BF & EI) | (HF & EC), F, E);
+		e[6] = select8(DH, D, E);
+		e[7] = select8((DH & EI) | (HF & EG), H, E);
+		e[8] = select8(HF, F, E);
+		uint16 *p = dst + x * 3;
+		for (int j = 0; j < 3; ++j, p += dstPitch) {
+			for (int i = 0; i < 8; ++i) {
+				p[i * 3] = e[j * 3][i];
+				p[i * 3 + 1] = e[j * 3 + 1][i];
+				p[i * 3 + 2] = e[j * 3 + 2][i];
+			}
+		}
+	}
+	for (; x < end; ++x) {
+		scale3xPixel(dst + x * 3, dstPitch, up[x - 1], up[x], up[x + 1], cur[x - 1], cur[x], cur[x + 1], down[x - 1], down[x], down[x + 1]);
+	}
+}
+
+void scale2x_fast(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h) {
+	dstPitch >>= 1;
+	while (h--) {
+		scale2xRow(dst, dstPitch, src - srcPitch, src, src + srcPitch, 0, w);
+		dst += dstPitch * 2;
+		src += srcPitch;
+	}
+}
+
+void scale3x_fast(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h) {
+	dstPitch >>= 1;
+	while (h--) {
+		scale3xRow(dst, dstPitch, src - srcPitch, src, src + srcPitch, 0, w);
+		dst += dstPitch * 3;
+		src += srcPitch;
+	}
+}
+
+void scale2x_edge(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h) {
+	dstPitch >>= 1;
+	if (w == 0) {
+		return;
+	}
+	const int r = w - 1;
+	for (int y = 0; y < h; ++y) {
+		const uint16 *up = (y == 0) ? src : src - srcPitch;
+		const uint16 *down = (y == h - 1) ? src : src + srcPitch;
+		scale2xPixel(dst, dstPitch, up[0], src[0], src[0], src[MIN(1, r)], down[0]);
+		if (r > 0) {
+			scale2xRow(dst, dstPitch, up, src, down, 1, r);
+			scale2xPixel(dst + r * 2, dstPitch, up[r], src[r - 1], src[r], src[r], down[r]);
+		}
+		dst += dstPitch * 2;
+		src += srcPitch;
+	}
+}
+
+void scale3x_edge(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h) {
+	dstPitch >>= 1;
+	if (w == 0) {
+		return;
+	}
+	const int r = w - 1;
+	for (int y = 0; y < h; ++y) {
+		const uint16 *up = (y == 0) ? src : src - srcPitch;
+		const uint16 *down = (y == h - 1) ? src : src + srcPitch;
+		const int x1 = MIN(1, r);
+		scale3xPixel(dst, dstPitch, up[0], up[0], up[x1], src[0], src[0], src[x1], down[0], down[0], down[x1]);
+		if (r > 0) {
+			scale3xRow(dst, dstPitch, up, src, down, 1, r);
+			scale3xPixel(dst + r * 3, dstPitch, up[r - 1], up[r], up[r], src[r - 1], src[r], src[r], down[r - 1], down[r], down[r]);
+		}
+		dst += dstPitch * 3;
+		src += srcPitch;
+	}
+}
@@ -23,7 +23,7 @@
 typedef void (*ScaleProc)(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
 
 enum {
-	NUM_SCALERS = 5
+	NUM_SCALERS = 7
 };
 
 struct Scaler {
@@ -40,4 +40,12 @@ void point3x(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, u
 void scale2x(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
 void scale3x(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
 
+// branchless versions, 8 pixels per iteration, same output as scale2x/scale3x
+void scale2x_fast(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
+void scale3x_fast(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
+
+// w x h is the whole image, neighbours are clamped at its borders
+void scale2x_edge(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
+void scale3x_edge(uint16 *dst, uint16 dstPitch, const uint16 *src, uint16 srcPitch, uint16 w, uint16 h);
+
 #endif // SCALER_H__
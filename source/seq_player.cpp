@@ -16,6 +16,7 @@
  */
 
 #include "file.h"
+#include "frame_scheduler.h"
 #include "fs.h"
 #include "mixer.h"
 #include "seq_player.h"
@@ -111,8 +112,10 @@ void SeqDemuxer::readPalette(uint8 *dst) {
 
 void SeqDemuxer::readAudioS8(uint8 *dst) {
 	_f->seek(_frameOffset + _audioDataOffset);
+	uint16 samples[kAudioBufferSize];
+	_f->readUint16BE(samples, kAudioBufferSize);
 	for (int i = 0; i < kAudioBufferSize; ++i) {
-		dst[i] = _f->readUint16BE() >> 8;
+		dst[i] = samples[i] >> 8;
 	}
 }
 
@@ -228,8 +231,8 @@ static const uint8 *decodeSeqOp3(uint8 *dst, int pitch, const uint8 *src) {
 	return src;
 }
 
-SeqPlayer::SeqPlayer(SystemStub *stub, Mixer *mixer)
-	: _stub(stub), _buf(0), _mix(mixer) {
+SeqPlayer::SeqPlayer(SystemStub *stub, Mixer *mixer, FrameScheduler *frameSched)
+	: _stub(stub), _buf(0), _mix(mixer), _frameSched(frameSched) {
 	_soundQueuePreloadSize = 0;
 	_soundQueue = 0;
 }
@@ -246,8 +249,9 @@ void SeqPlayer::play(File *f) {
 		_mix->setPremixHook(mixCallback, this);
 		memset(_buf, 0, 256 * 224);
 		bool clearScreen = true;
+		bool presentFrame = true;
+		_frameSched->reset();
 		while (true) {
-			const uint32 nextFrameTimeStamp = _stub->getTimeStamp() + 1000 / 25;
 			_stub->processEvents();
 			if (_stub->_pi.quit || _stub->_pi.backspace) {
 				_stub->_pi.backspace = false;
@@ -315,19 +319,20 @@ void SeqPlayer::play(File *f) {
 						}
 					}
 				}
-				if (clearScreen) {
-					clearScreen = false;
-					_stub->copyRect(0, 0, kVideoWidth, 224, _buf, 256);
-				} else {
-					_stub->copyRect(0, y0, kVideoWidth, kVideoHeight, _buf, 256);
+				// a skipped frame is caught up by the next copy of the whole video area
+				if (presentFrame) {
+					if (clearScreen) {
+						clearScreen = false;
+						_stub->copyRect(0, 0, kVideoWidth, 224, _buf, 256);
+					} else {
+						_stub->copyRect(0, y0, kVideoWidth, kVideoHeight, _buf, 256);
+					}
+					_stub->updateScreen(0);
 				}
-				_stub->updateScreen(0);
-			}
-			const int diff = nextFrameTimeStamp - _stub->getTimeStamp();
-			if (diff > 0) {
-				_stub->sleep(diff);
 			}
+			presentFrame = _frameSched->waitFrame(1000000 / 25);
 		}
+		_frameSched->dumpStats("SeqPlayer");
 		for (int i = 0; i < 256; ++i) {
 			_stub->setPaletteEntry(i, &pal[i]);
 		}
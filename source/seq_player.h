@@ -21,6 +21,7 @@
 #include "intern.h"
 
 struct File;
+struct FrameScheduler;
 struct SystemStub;
 struct Mixer;
 
@@ -72,7 +73,7 @@ struct SeqPlayer {
 		SoundBufferQueue *next;
 	};
 
-	SeqPlayer(SystemStub *stub, Mixer *mixer);
+	SeqPlayer(SystemStub *stub, Mixer *mixer, FrameScheduler *frameSched);
 	~SeqPlayer();
 
 	void setBackBuffer(uint8 *buf) { _buf = buf; }
@@ -83,6 +84,7 @@ struct SeqPlayer {
 	SystemStub *_stub;
 	uint8 *_buf;
 	Mixer *_mix;
+	FrameScheduler *_frameSched;
 	SeqDemuxer _demux;
 	int _soundQueuePreloadSize;
 	SoundBufferQueue *_soundQueue;
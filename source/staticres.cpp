@@ -19,28 +19,6 @@
 #include "resource.h"
 
 
-const Cutscene::OpcodeStub Cutscene::_opcodeTable[] = {
-	/* 0x00 */
-	&Cutscene::op_markCurPos,
-	&Cutscene::op_refreshScreen,
-	&Cutscene::op_waitForSync,
-	&Cutscene::op_drawShape,
-	/* 0x04 */
-	&Cutscene::op_setPalette,
-	&Cutscene::op_markCurPos,
-	&Cutscene::op_drawStringAtBottom,
-	&Cutscene::op_nop,
-	/* 0x08 */
-	&Cutscene::op_skip3,
-	&Cutscene::op_refreshAll,
-	&Cutscene::op_drawShapeScale,
-	&Cutscene::op_drawShapeScaleRotate,
-	/* 0x0C */
-	&Cutscene::op_drawCreditsText,
-	&Cutscene::op_drawStringAtPos,
-	&Cutscene::op_handleKeys
-};
-
 const char *Cutscene::_namesTable[] = {
 	"DEBUT",
 	"OBJET",
@@ -24,6 +24,7 @@ typedef uint16_t uint16;
 typedef int16_t int16;
 typedef uint32_t uint32;
 typedef int32_t int32;
+typedef uint64_t uint64;
 
 inline void SWAP_UINT16(uint16 *ptr) {
 	const uint8 hi = *ptr >> 8;
@@ -51,12 +51,15 @@ struct PlayerInput {
 
 	bool mirrorMode;
 
+	bool capture;
+
 	uint8 dbgMask;
 	bool quit;
 };
 
 struct SystemStub {
 	typedef void (*AudioCallback)(void *param, uint8 *stream, int len);
+	typedef void (*ThreadProc)(void *param);
 
 	PlayerInput _pi;
 
@@ -76,12 +79,25 @@ struct SystemStub {
 	virtual void processEvents() = 0;
 	virtual void sleep(int duration) = 0;
 	virtual uint32 getTimeStamp() = 0;
+	virtual uint32 getTimeStampUs() = 0;
 
 	virtual void startAudio(AudioCallback callback, void *param) = 0;
 	virtual void stopAudio() = 0;
 	virtual uint32 getOutputSampleRate() = 0;
 	virtual void lockAudio() = 0;
 	virtual void unlockAudio() = 0;
+
+	virtual void *createThread(ThreadProc proc, void *param) = 0;
+	virtual void joinThread(void *thread) = 0;
+	virtual void *createMutex() = 0;
+	virtual void destroyMutex(void *mutex) = 0;
+	virtual void lockMutex(void *mutex) = 0;
+	virtual void unlockMutex(void *mutex) = 0;
+	// auto reset event, a signal is kept until a thread waits for it
+	virtual void *createEvent() = 0;
+	virtual void destroyEvent(void *event) = 0;
+	virtual void signalEvent(void *event) = 0;
+	virtual void waitEvent(void *event) = 0;
 };
 
 struct LockAudioStack {
@@ -95,6 +111,18 @@ struct LockAudioStack {
 	SystemStub *_stub;
 };
 
+struct MutexStack {
+	MutexStack(SystemStub *stub, void *mutex)
+		: _stub(stub), _mutex(mutex) {
+		_stub->lockMutex(_mutex);
+	}
+	~MutexStack() {
+		_stub->unlockMutex(_mutex);
+	}
+	SystemStub *_stub;
+	void *_mutex;
+};
+
 extern SystemStub *SystemStub_THREEDS_Create();
 
 #endif // SYSTEMSTUB_H__
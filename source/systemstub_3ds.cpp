@@ -19,6 +19,7 @@
 
 #include "scaler.h"
 #include "systemstub.h"
+#include "util.h"
 
 // 3DS Specific
 #include <3ds.h>
@@ -133,6 +134,29 @@ struct SystemStub_THREEDS : SystemStub {
   // Full screen or centered?
   bool m_fullScreen;
 
+  // RGB565 copy of the indexed screen, with a one pixel apron on each side
+  // so the scale2x/scale3x neighbourhood never reads outside the buffer.
+  u16* m_rgbBuffer;
+  int m_rgbPitch;
+
+  // Output of the selected scaler, sampled by the fullscreen LUT.
+  u16* m_scaledBuffer;
+  int m_scaledPitch;
+  int m_scaler;
+
+  // Rectangles updated by copyRect since the last updateScreen.
+  struct DirtyRect {
+    int x, y, w, h;
+  };
+  DirtyRect m_dirtyRects[MAX_BLIT_RECTS];
+  int m_numDirtyRects;
+  bool m_fullDirty;
+
+  // Scaling cost, in microseconds.
+  u32 m_scaleTimeLast;
+  u32 m_scaleTimeTotal;
+  u32 m_scaledFrames;
+
   // Initialized screen size
   unsigned int m_screenWidth;
   unsigned int m_screenHeight;
@@ -153,11 +177,31 @@ struct SystemStub_THREEDS : SystemStub {
 	virtual void processEvents();
 	virtual void sleep(int duration);
 	virtual uint32 getTimeStamp();
+	virtual uint32 getTimeStampUs();
 	virtual void startAudio(AudioCallback callback, void *param);
 	virtual void stopAudio();
 	virtual uint32 getOutputSampleRate();
 	virtual void lockAudio();
 	virtual void unlockAudio();
+	virtual void *createThread(ThreadProc proc, void *param);
+	virtual void joinThread(void *thread);
+	virtual void *createMutex();
+	virtual void destroyMutex(void *mutex);
+	virtual void lockMutex(void *mutex);
+	virtual void unlockMutex(void *mutex);
+	virtual void *createEvent();
+	virtual void destroyEvent(void *event);
+	virtual void signalEvent(void *event);
+	virtual void waitEvent(void *event);
+
+  // Scaling stage.
+  void addDirtyRect(int x, int y, int w, int h);
+  void convertRect(int x, int y, int w, int h);
+  void scaleRect(int x, int y, int w, int h);
+  void scaleDirtyRects();
+  void setScaler(int scaler);
+  void computeFullscreenLUT();
+  void benchmarkScalers();
 
   // Render options menu.
   void loadOptions();
@@ -190,6 +234,13 @@ void SystemStub_THREEDS::init(const char *title, int width, int height) {
   // Configure overscan color
   m_overScanColor = 0;
 
+  // Nothing presented yet
+  m_numDirtyRects = 0;
+  m_fullDirty = true;
+  m_scaleTimeLast = 0;
+  m_scaleTimeTotal = 0;
+  m_scaledFrames = 0;
+
   // Configure command names
   for (int i = 0; i < KBT_MAX_TARGETS; ++i) {
     switch (i) {
@@ -238,28 +289,17 @@ void SystemStub_THREEDS::init(const char *title, int width, int height) {
     m_screenBufferPtr = new (std::nothrow) u8[m_screenWidth * m_screenHeight];
     memset(m_screenBufferPtr, 0, m_screenWidth * m_screenHeight * sizeof(u8));
 
-    // Calculate fullscreen LUT
-    m_fullscreenLUT = new (std::nothrow) size_t[fbWidth * fbHeight];
-    memset(m_fullscreenLUT, 0, fbWidth * fbHeight * sizeof(size_t));
-
-    for (float j = 0; j < fbWidth; ++j) {
-      for (float i = 0; i < fbHeight; ++i) {
-        size_t y = (j / (float)fbWidth) * m_screenHeight;
-        if (y >= m_screenHeight)
-          y = m_screenHeight - 1;
+    // Intermediate 16 bits buffers, the scaled one is sized for the biggest
+    // scaling factor so switching scalers never reallocates.
+    m_rgbPitch = m_screenWidth + 2;
+    m_rgbBuffer = new (std::nothrow) u16[m_rgbPitch * (m_screenHeight + 2)];
+    memset(m_rgbBuffer, 0, m_rgbPitch * (m_screenHeight + 2) * sizeof(u16));
 
-        size_t x = (i / (float)fbHeight) * m_screenWidth;
-        if (x >= m_screenWidth)
-          x = m_screenWidth - 1;
-
-        const int deltaY = fbWidth - m_screenHeight;
-        const size_t lutAddr = (m_screenHeight - j + deltaY) + i * fbWidth;
-
-        const size_t bufferAddr = x + y * m_screenWidth;
-        m_fullscreenLUT[lutAddr] = bufferAddr;
-      }
-    }
+    m_scaledBuffer = new (std::nothrow) u16[m_screenWidth * 3 * m_screenHeight * 3];
+    memset(m_scaledBuffer, 0, m_screenWidth * 3 * m_screenHeight * 3 * sizeof(u16));
 
+    m_fullscreenLUT = new (std::nothrow) size_t[fbWidth * fbHeight];
+    setScaler(0);
   } else {
     vAssert(false, "Failed to get framebuffer pointer on ::init");
   }
@@ -275,6 +315,12 @@ void SystemStub_THREEDS::destroy() {
   if (m_fullscreenLUT != 0)
     delete [] m_fullscreenLUT;
 
+  if (m_rgbBuffer != 0)
+    delete [] m_rgbBuffer;
+
+  if (m_scaledBuffer != 0)
+    delete [] m_scaledBuffer;
+
   if (m_palette != 0)
     delete [] m_palette;
 
@@ -289,6 +335,7 @@ void SystemStub_THREEDS::destroy() {
 void SystemStub_THREEDS::setPalette(const uint8* pal, int n) {
 	vAssert(n <= PAL_MAX_SIZE, "Invalid palette index: " << n);
   memcpy(m_palette, pal, sizeof(uint8) * n * 3);
+  m_fullDirty = true;
 }
 
 void SystemStub_THREEDS::setPaletteEntry(int i, const Color* c) {
@@ -298,6 +345,7 @@ void SystemStub_THREEDS::setPaletteEntry(int i, const Color* c) {
   m_palette[i * 3 + 0] = (c->r << 2) | (c->r & 3);
   m_palette[i * 3 + 1] = (c->g << 2) | (c->g & 3);
   m_palette[i * 3 + 2] = (c->b << 2) | (c->b & 3);
+  m_fullDirty = true;
 }
 
 void SystemStub_THREEDS::getPaletteEntry(int i, Color* c) {
@@ -317,11 +365,15 @@ void SystemStub_THREEDS::copyRect(int x, int y, int w, int h, const uint8* buf,
   if (x >= (int)m_screenWidth || y >= (int)m_screenHeight)
     return;
 
-  if (x < 0)
+  if (x < 0) {
+    w += x;
     x = 0;
+  }
 
-  if (y < 0)
+  if (y < 0) {
+    h += y;
     y = 0;
+  }
 
   if (x + w > (int)m_screenWidth)
     w = m_screenWidth - x;
@@ -329,15 +381,146 @@ void SystemStub_THREEDS::copyRect(int x, int y, int w, int h, const uint8* buf,
   if (y + h > (int)m_screenHeight)
     h = m_screenHeight - y;
 
+  if (w <= 0 || h <= 0)
+    return;
+
   for (int j = 0; j < h; ++j) {
-    const size_t baseAddr0 = (y + j) * pitch;
+    memcpy(m_screenBufferPtr + (y + j) * m_screenWidth + x, 
+      buf + (y + j) * pitch + x, w);
+  }
+
+  addDirtyRect(x, y, w, h);
+}
+
+void SystemStub_THREEDS::addDirtyRect(int x, int y, int w, int h) {
+  if (m_fullDirty)
+    return;
+
+  if (m_numDirtyRects == MAX_BLIT_RECTS) {
+    m_fullDirty = true;
+    return;
+  }
+
+  DirtyRect* r = &m_dirtyRects[m_numDirtyRects++];
+  r->x = x;
+  r->y = y;
+  r->w = w;
+  r->h = h;
+}
+
+// Palette lookup of a rectangle of the indexed screen into the 16 bits 
+// buffer, refreshing the apron when the rectangle touches a border.
+void SystemStub_THREEDS::convertRect(int x, int y, int w, int h) {
+  u16 pal565[256];
+  for (int i = 0; i < 256; ++i) {
+    const u8* color = &m_palette[i * 3];
+    pal565[i] = RGB8_to_565(color[0], color[1], color[2]);
+  }
+
+  for (int j = y; j < y + h; ++j) {
+    const u8* src = m_screenBufferPtr + j * m_screenWidth + x;
+    u16* dst = m_rgbBuffer + (j + 1) * m_rgbPitch + x + 1;
+    for (int i = 0; i < w; ++i)
+      dst[i] = pal565[src[i]];
 
-    for (int i = 0; i < w; ++i) {
-      const size_t baseAddr = x + i + baseAddr0; 
-      vAssert(baseAddr < m_screenWidth * m_screenHeight, 
-        "Base address is bigger than buffer: " << baseAddr);
+    if (x == 0)
+      dst[-1] = dst[0];
 
-      m_screenBufferPtr[baseAddr] = buf[baseAddr];
+    if (x + w == (int)m_screenWidth)
+      dst[w] = dst[w - 1];
+  }
+
+  if (y == 0) {
+    u16* row = m_rgbBuffer + x;
+    memcpy(row, row + m_rgbPitch, (w + 2) * sizeof(u16));
+  }
+
+  if (y + h == (int)m_screenHeight) {
+    u16* row = m_rgbBuffer + (m_screenHeight + 1) * m_rgbPitch + x;
+    memcpy(row, row - m_rgbPitch, (w + 2) * sizeof(u16));
+  }
+}
+
+void SystemStub_THREEDS::scaleRect(int x, int y, int w, int h) {
+  const Scaler* scaler = &_scalers[m_scaler];
+  const u16* src = m_rgbBuffer + (y + 1) * m_rgbPitch + x + 1;
+  u16* dst = m_scaledBuffer + y * scaler->factor * m_scaledPitch + x * scaler->factor;
+  scaler->proc(dst, m_scaledPitch * sizeof(u16), src, m_rgbPitch, w, h);
+}
+
+// Only the rectangles changed since the last frame are converted, and they 
+// are scaled with a one pixel margin since the scale2x/scale3x output of a 
+// pixel depends on its neighbours.
+void SystemStub_THREEDS::scaleDirtyRects() {
+  const u64 startTick = svcGetSystemTick();
+
+  if (m_fullDirty) {
+    convertRect(0, 0, m_screenWidth, m_screenHeight);
+    if (m_fullScreen)
+      scaleRect(0, 0, m_screenWidth, m_screenHeight);
+  } else {
+    for (int i = 0; i < m_numDirtyRects; ++i) {
+      const DirtyRect* r = &m_dirtyRects[i];
+      convertRect(r->x, r->y, r->w, r->h);
+    }
+
+    if (m_fullScreen) {
+      const int apron = (_scalers[m_scaler].factor > 1) ? 1 : 0;
+      for (int i = 0; i < m_numDirtyRects; ++i) {
+        const DirtyRect* r = &m_dirtyRects[i];
+        const int x1 = MAX(r->x - apron, 0);
+        const int y1 = MAX(r->y - apron, 0);
+        const int x2 = MIN(r->x + r->w + apron, (int)m_screenWidth);
+        const int y2 = MIN(r->y + r->h + apron, (int)m_screenHeight);
+        scaleRect(x1, y1, x2 - x1, y2 - y1);
+      }
+    }
+  }
+
+  m_fullDirty = false;
+  m_numDirtyRects = 0;
+
+  m_scaleTimeLast = (svcGetSystemTick() - startTick) / (SYSCLOCK_ARM11 / 1000000);
+  m_scaleTimeTotal += m_scaleTimeLast;
+  ++m_scaledFrames;
+  debug(DBG_VIDEO, "SystemStub_THREEDS::scaleDirtyRects() %s %d us", 
+    _scalers[m_scaler].name, m_scaleTimeLast);
+}
+
+void SystemStub_THREEDS::setScaler(int scaler) {
+  m_scaler = scaler;
+  m_scaledPitch = m_screenWidth * _scalers[m_scaler].factor;
+  m_scaleTimeTotal = 0;
+  m_scaledFrames = 0;
+  m_fullDirty = true;
+  computeFullscreenLUT();
+}
+
+// Index in framebuffer => index in the scaled buffer.
+void SystemStub_THREEDS::computeFullscreenLUT() {
+  u16 fbWidth = 0, fbHeight = 0;
+  gfxGetFramebuffer(GFX_TOP, GFX_LEFT, &fbWidth, &fbHeight);
+
+  const int factor = _scalers[m_scaler].factor;
+  const size_t scaledWidth = m_screenWidth * factor;
+  const size_t scaledHeight = m_screenHeight * factor;
+
+  memset(m_fullscreenLUT, 0, fbWidth * fbHeight * sizeof(size_t));
+  for (float j = 0; j < fbWidth; ++j) {
+    for (float i = 0; i < fbHeight; ++i) {
+      size_t y = (j / (float)fbWidth) * scaledHeight;
+      if (y >= scaledHeight)
+        y = scaledHeight - 1;
+
+      size_t x = (i / (float)fbHeight) * scaledWidth;
+      if (x >= scaledWidth)
+        x = scaledWidth - 1;
+
+      const int deltaY = fbWidth - m_screenHeight;
+      const size_t lutAddr = (m_screenHeight - j + deltaY) + i * fbWidth;
+
+      vAssert(lutAddr < (size_t)(fbWidth * fbHeight), "Invalid LUT address " << lutAddr);
+      m_fullscreenLUT[lutAddr] = x + y * m_scaledPitch;
     }
   }
 }
@@ -356,6 +539,8 @@ void SystemStub_THREEDS::updateScreen(int shakeOffset) {
   vAssert(fbWidth > 0, "Invalid framebuffer width " << fbWidth);
   vAssert(fbHeight > 0, "Invalid framebuffer height " << fbHeight);
 
+  scaleDirtyRects();
+
   // Centered or Scaled?
   if (!m_fullScreen) {
     // Figure out proper X and Y to start rendering at
@@ -363,28 +548,19 @@ void SystemStub_THREEDS::updateScreen(int shakeOffset) {
     const int startY = (fbWidth / 2) - (m_screenHeight / 2);
 
     for (size_t j = 0; j < m_screenHeight; ++j) {
+      const u16* src = m_rgbBuffer + (j + 1) * m_rgbPitch + 1;
       for (size_t i = 0; i < m_screenWidth; ++i) {
-        
-        const size_t index = m_screenBufferPtr[i + j * m_screenWidth];
-        vAssert(index < PAL_MAX_SIZE, "Invalid palette index " << index);
-        
         // 3DS screen is 90' rotated.
-        const u8* color = &m_palette[index * 3];
         const size_t baseAddr = ((m_screenHeight - j + startY) + 
           (i + startX) * fbWidth);
 
-        framebufferPtr[baseAddr] = RGB8_to_565(color[0], color[1], color[2]);
+        framebufferPtr[baseAddr] = src[i];
       }
     }
   } else {
     const size_t fbSize = fbWidth * fbHeight;
-    for (size_t i = 0; i < fbSize; ++i) {
-      const size_t index = m_screenBufferPtr[m_fullscreenLUT[i]];
-      vAssert(index < PAL_MAX_SIZE, "Invalid palette index " << index);
-        
-      const u8* color = &m_palette[index * 3];
-      framebufferPtr[i] = RGB8_to_565(color[0], color[1], color[2]);
-    }
+    for (size_t i = 0; i < fbSize; ++i)
+      framebufferPtr[i] = m_scaledBuffer[m_fullscreenLUT[i]];
   }
 
   // Flush and swap framebuffers
@@ -507,6 +683,13 @@ uint32 SystemStub_THREEDS::getTimeStamp() {
   return time;
 }
 
+uint32 SystemStub_THREEDS::getTimeStampUs() {
+  const u64 deltaTime = (svcGetSystemTick() - m_startTick) / (TICKS_PER_SEC / 1000000);
+  const u32 time = deltaTime & 0xFFFFFFFF;
+
+  return time;
+}
+
 // Audio callback used by Flashback
 // typedef void (*AudioCallback)(void *param, uint8 *stream, int len);
 #define AUDIO_BUFFER_LENGTH 8192
@@ -638,6 +821,69 @@ void SystemStub_THREEDS::unlockAudio() {
   svcReleaseMutex(m_audioCore.mutex);
 }
 
+// Worker threads run just below the main thread priority. The New 3DS has a
+// free core for them, elsewhere they use the time the main thread spends
+// waiting for the vblank, the timers and the events.
+void* SystemStub_THREEDS::createThread(ThreadProc proc, void *param) {
+	s32 currPriority = 0;
+	svcGetThreadPriority(&currPriority, CUR_THREAD_HANDLE);
+
+  Thread thread = 0;
+  bool isNew3DS = false;
+  if (R_SUCCEEDED(APT_CheckNew3DS(&isNew3DS)) && isNew3DS)
+    thread = threadCreate(proc, param, 32 * 1024, currPriority + 1, 2, false);
+
+  if (thread == 0)
+    thread = threadCreate(proc, param, 32 * 1024, currPriority + 1, -2, false);
+
+  return thread;
+}
+
+void SystemStub_THREEDS::joinThread(void *thread) {
+  threadJoin((Thread)thread, U64_MAX);
+  threadFree((Thread)thread);
+}
+
+void* SystemStub_THREEDS::createMutex() {
+  LightLock* lock = new (std::nothrow) LightLock;
+  if (lock != 0)
+    LightLock_Init(lock);
+
+  return lock;
+}
+
+void SystemStub_THREEDS::destroyMutex(void *mutex) {
+  delete (LightLock*)mutex;
+}
+
+void SystemStub_THREEDS::lockMutex(void *mutex) {
+  LightLock_Lock((LightLock*)mutex);
+}
+
+void SystemStub_THREEDS::unlockMutex(void *mutex) {
+  LightLock_Unlock((LightLock*)mutex);
+}
+
+void* SystemStub_THREEDS::createEvent() {
+  LightEvent* event = new (std::nothrow) LightEvent;
+  if (event != 0)
+    LightEvent_Init(event, RESET_ONESHOT);
+
+  return event;
+}
+
+void SystemStub_THREEDS::destroyEvent(void *event) {
+  delete (LightEvent*)event;
+}
+
+void SystemStub_THREEDS::signalEvent(void *event) {
+  LightEvent_Signal((LightEvent*)event);
+}
+
+void SystemStub_THREEDS::waitEvent(void *event) {
+  LightEvent_Wait((LightEvent*)event);
+}
+
 static const char* selectedOption(int index, int desired) {
   return (index == desired ? "\x1b[32m  " : "  ");
 }
@@ -715,36 +961,129 @@ static u16 pickCommand(SystemStub_THREEDS* systemPtr) {
   return 0;
 }
   
+// Times the scalar scale2x/scale3x against the branchless and edge clamped
+// versions on the frame currently displayed, and checks they all produce the 
+// same pixels. The edge clamped versions do not read the apron, so only the
+// interior is compared for them.
+void SystemStub_THREEDS::benchmarkScalers() {
+  static const int kIterations = 16;
+  static const struct {
+    const char* name;
+    ScaleProc ref, fast, edge;
+    int factor;
+  } kBenchmarks[] = {
+    { "scale2x", &scale2x, &scale2x_fast, &scale2x_edge, 2 },
+    { "scale3x", &scale3x, &scale3x_fast, &scale3x_edge, 3 }
+  };
+
+  const size_t scaledSize = m_screenWidth * 3 * m_screenHeight * 3;
+  u16* refBuffer = new (std::nothrow) u16[scaledSize];
+  u16* outBuffer = new (std::nothrow) u16[scaledSize];
+  if (refBuffer == 0 || outBuffer == 0) {
+    delete [] refBuffer;
+    delete [] outBuffer;
+    return;
+  }
+
+  consoleClear();
+  std::cout << std::endl << " Scalers benchmark (" << m_screenWidth << "x" << 
+    m_screenHeight << ", " << kIterations << " runs):" << std::endl << std::endl;
+
+  const u16* src = m_rgbBuffer + m_rgbPitch + 1;
+  for (size_t b = 0; b < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); ++b) {
+    const int factor = kBenchmarks[b].factor;
+    const int dstPitch = m_screenWidth * factor;
+    const ScaleProc procs[] = { kBenchmarks[b].ref, kBenchmarks[b].fast, kBenchmarks[b].edge };
+    const char* names[] = { "scalar", "fast", "edge" };
+
+    for (int p = 0; p < 3; ++p) {
+      u16* dst = (p == 0) ? refBuffer : outBuffer;
+      const u64 startTick = svcGetSystemTick();
+      for (int i = 0; i < kIterations; ++i)
+        procs[p](dst, dstPitch * sizeof(u16), src, m_rgbPitch, m_screenWidth, m_screenHeight);
+
+      const u32 timeUs = (svcGetSystemTick() - startTick) / 
+        (SYSCLOCK_ARM11 / 1000000) / kIterations;
+
+      int mismatches = 0;
+      if (p != 0) {
+        const int border = (p == 2) ? factor : 0;
+        for (int y = border; y < (int)m_screenHeight * factor - border; ++y) {
+          const u16* r = refBuffer + y * dstPitch;
+          const u16* o = outBuffer + y * dstPitch;
+          for (int x = border; x < dstPitch - border; ++x)
+            mismatches += (r[x] != o[x]);
+        }
+      }
+
+      std::cout << "  " << kBenchmarks[b].name << " " << names[p] << ": " << 
+        timeUs << " us";
+      if (p != 0 && mismatches == 0)
+        std::cout << ", exact";
+      else if (p != 0)
+        std::cout << ", " << mismatches << " mismatches";
+      std::cout << std::endl;
+    }
+    std::cout << std::endl;
+  }
+
+  delete [] refBuffer;
+  delete [] outBuffer;
+
+  std::cout << std::endl << " Press A to return." << std::endl;
+  while (aptMainLoop()) {
+    hidScanInput();
+    if (hidKeysUp() & KEY_A)
+      break;
+
+    gfxFlushBuffers();
+    gfxSwapBuffers();
+    gspWaitForVBlank();
+  }
+}
+
 void SystemStub_THREEDS::selectOption(int selectedIndex) {
   switch (selectedIndex) {
   case 0: // Full screen
     m_fullScreen = !m_fullScreen;
     if (!m_fullScreen) 
       clearFramebuffers();
+    m_fullDirty = true;
+    break;
+  case 1: // Scaler
+    setScaler((m_scaler + 1) % NUM_SCALERS);
+    break;
+  case 2: // Benchmark
+    benchmarkScalers();
+    break;
+  case 3: // Capture
+    _pi.capture = true;
+    m_paused = false;
+    m_audioCore.playing = true;
     break;
-  case 1: // L
+  case 4: // L
     m_keyBindings[KI_KEY_L] = pickCommand(this);
     break;
-  case 2: // R
+  case 5: // R
     m_keyBindings[KI_KEY_R] = pickCommand(this);
     break;
-  case 3: // A
+  case 6: // A
     m_keyBindings[KI_KEY_A] = pickCommand(this);
     break;
-  case 4: // B
+  case 7: // B
     m_keyBindings[KI_KEY_B] = pickCommand(this);
     break;
-  case 5: // X
+  case 8: // X
     m_keyBindings[KI_KEY_X] = pickCommand(this);
     break;
-  case 6: // Y
+  case 9: // Y
     m_keyBindings[KI_KEY_Y] = pickCommand(this);
     break;
-  case 7: // PAUSE
+  case 10: // PAUSE
     m_paused = false;
     m_audioCore.playing = true;
     break;
-  case 8: // QUIT
+  case 11: // QUIT
     _pi.quit = true;
     break;
   }
@@ -755,44 +1094,54 @@ void SystemStub_THREEDS::renderOptionsText(int selectedIndex) {
   std::cout << std::endl << " Video:" << std::endl << std::endl;
   std::cout << selectedOption(selectedIndex, 0) << 
     (m_fullScreen ? " Display scaled (Unstable)" : " Normal size") <<
-    clearColor() << std::endl << std::endl << std::endl;
+    clearColor() << std::endl << std::endl;
+
+  std::cout << selectedOption(selectedIndex, 1) << " Scaler (" << 
+    _scalers[m_scaler].name << ")" << clearColor() << std::endl;
+  std::cout << "   Scaling: " << m_scaleTimeLast << " us, avg " << 
+    (m_scaledFrames != 0 ? m_scaleTimeTotal / m_scaledFrames : 0) << 
+    " us" << std::endl;
+  std::cout << selectedOption(selectedIndex, 2) << " Benchmark scalers" << 
+    clearColor() << std::endl;
+  std::cout << selectedOption(selectedIndex, 3) << " Start/stop capture" << 
+    clearColor() << std::endl;
   
   std::cout << std::endl << " Controls:" << std::endl << std::endl;
-  std::cout << selectedOption(selectedIndex, 1) << " Shoulder L (" << 
+  std::cout << selectedOption(selectedIndex, 4) << " Shoulder L (" << 
     bindingName(m_keyBindings[KI_KEY_L]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << selectedOption(selectedIndex, 2) << " Shoulder R (" << 
+  std::cout << selectedOption(selectedIndex, 5) << " Shoulder R (" << 
     bindingName(m_keyBindings[KI_KEY_R]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << selectedOption(selectedIndex, 3) << " A (" << 
+  std::cout << selectedOption(selectedIndex, 6) << " A (" << 
     bindingName(m_keyBindings[KI_KEY_A]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << selectedOption(selectedIndex, 4) << " B (" << 
+  std::cout << selectedOption(selectedIndex, 7) << " B (" << 
     bindingName(m_keyBindings[KI_KEY_B]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << selectedOption(selectedIndex, 5) << " X (" << 
+  std::cout << selectedOption(selectedIndex, 8) << " X (" << 
     bindingName(m_keyBindings[KI_KEY_X]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << selectedOption(selectedIndex, 6) << " Y (" << 
+  std::cout << selectedOption(selectedIndex, 9) << " Y (" << 
     bindingName(m_keyBindings[KI_KEY_Y]) << ")" << clearColor() << 
     std::endl << std::endl;
   
-  std::cout << std::endl << std::endl << "\t\t\t" << 
-    selectedOption(selectedIndex, 7) << " Return to game" << 
+  std::cout << std::endl << "\t\t\t" << 
+    selectedOption(selectedIndex, 10) << " Return to game" << 
     clearColor() << std::endl;
   
   std::cout << std::endl << "\t\t\t" << 
-    selectedOption(selectedIndex, 8) << " Exit Game" << 
+    selectedOption(selectedIndex, 11) << " Exit Game" << 
     clearColor() << std::endl << std::endl;
 }
       
 void SystemStub_THREEDS::renderOptions() {
-  const int maxOptions = 8;
+  const int maxOptions = 11;
   int selectedIndex = 0;
 
   renderOptionsText(selectedIndex);
@@ -855,6 +1204,11 @@ void SystemStub_THREEDS::loadOptions() {
     } else
       m_keyBindings[i] = key;
   }
+
+  // Older files have no scaler entry
+  int scaler = 0;
+  if (optionsFile >> scaler && scaler >= 0 && scaler < NUM_SCALERS)
+    setScaler(scaler);
 }
 
 void SystemStub_THREEDS::saveOptions() {
@@ -865,5 +1219,7 @@ void SystemStub_THREEDS::saveOptions() {
   optionsFile << m_fullScreen << std::endl;
   for (int i = 0; i < KI_KEY_MAX_KEYS; ++i)
     optionsFile << m_keyBindings[i] << std::endl;
+
+  optionsFile << m_scaler << std::endl;
 }
 
@@ -17,86 +17,160 @@
 
 #include "unpack.h"
 
+// The packed stream is read backwards from its end : the unpacked size, the
+// crc and then 32 bits words whose bits are consumed from the lsb. The codes
+// are made of the successive bits, first one as msb, so the words are bit
+// reversed when they enter the buffer and the codes are read from its top.
 
-static int rcr(UnpackCtx *uc, int CF) {
-	int rCF = (uc->chk & 1);
-	uc->chk >>= 1;
-	if (CF) {
-		uc->chk |= 0x80000000;
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+static const uint8 _bitReverseTable[256] = {
+	R6(0), R6(2), R6(1), R6(3)
+};
+
+#undef R2
+#undef R4
+#undef R6
+
+static inline uint32 reverseBits(uint32 n) {
+	return (_bitReverseTable[n & 255] << 24) | (_bitReverseTable[(n >> 8) & 255] << 16) | (_bitReverseTable[(n >> 16) & 255] << 8) | _bitReverseTable[n >> 24];
+}
+
+static void refill(UnpackCtx *uc) {
+	uint32 n = 0;
+	if (uc->srcOffset >= 0) {
+		n = READ_BE_UINT32(uc->src + uc->srcOffset);
+		uc->srcOffset -= 4;
+		uc->crc ^= n;
+	} else {
+		// past the start of the buffer, keep going with zeroes until the end of the output
+		uc->truncated = true;
 	}
-	return rCF;
+	uc->bits |= (uint64)reverseBits(n) << (32 - uc->bitsCount);
+	uc->bitsCount += 32;
 }
 
-static int next_chunk(UnpackCtx *uc) {
-	int CF = rcr(uc, 0);
-	if (uc->chk == 0) {
-		uc->chk = READ_BE_UINT32(uc->src); uc->src -= 4;
-		uc->crc ^= uc->chk;
-		CF = rcr(uc, 1);
+// a word is only loaded when one of its bits is needed, the crc covers the same words as the original code
+static inline uint32 getCode(UnpackCtx *uc, int count) {
+	if (uc->bitsCount < count) {
+		refill(uc);
 	}
-	return CF;
+	const uint32 code = (uint32)(uc->bits >> (64 - count));
+	uc->bits <<= count;
+	uc->bitsCount -= count;
+	return code;
 }
 
-static uint16 get_code(UnpackCtx *uc, uint8 num_chunks) {
-	uint16 c = 0;
-	while (num_chunks--) {
-		c <<= 1;
-		if (next_chunk(uc)) {
-			c |= 1;
+// dst[i] = dst[i + offset] going downwards, the areas overlap when offset < count
+static inline void copyBackwards(uint8 *dst, uint32 count, uint32 offset) {
+	if (offset >= count) {
+		memcpy(dst, dst + offset, count);
+	} else if (offset == 1) {
+		memset(dst, dst[count], count);
+	} else if (offset != 0) {
+		// the copied bytes repeat with a period of 'offset', double the size of the chunks as they get written
+		uint8 *p = dst + count;
+		while (count != 0) {
+			const uint32 len = MIN(offset, count);
+			p -= len;
+			memcpy(p, p + offset, len);
+			count -= len;
+			offset += len;
 		}
 	}
-	return c;
 }
 
-static void dec_unk1(UnpackCtx *uc, uint8 num_chunks, uint8 add_count) {
-	uint16 count = get_code(uc, num_chunks) + add_count + 1;
-	uc->datasize -= count;
-	while (count--) {
-		*uc->dst = (uint8)get_code(uc, 8);
-		--uc->dst;
+static bool dec_unk1(UnpackCtx *uc, uint32 count) {
+	if (count > (uint32)(uc->dst - uc->dstStart)) {
+		debug(DBG_UNPACK, "delphine_unpack() bad literals count=%d at 0x%X", count, (uint32)(uc->dst - uc->dstStart));
+		return false;
 	}
+	uint8 *p = uc->dst;
+	uc->dst -= count;
+	do {
+		*--p = (uint8)getCode(uc, 8);
+	} while (p != uc->dst);
+	return true;
 }
 
-static void dec_unk2(UnpackCtx *uc, uint8 num_chunks) {
-	uint16 i = get_code(uc, num_chunks);
-	uint16 count = uc->size + 1;
-	uc->datasize -= count;
-	while (count--) {
-		*uc->dst = *(uc->dst + i);
-		--uc->dst;
+static bool dec_unk2(UnpackCtx *uc, uint32 count, uint32 offset) {
+	if (count > (uint32)(uc->dst - uc->dstStart) || offset > (uint32)(uc->dstEnd - uc->dst)) {
+		debug(DBG_UNPACK, "delphine_unpack() bad copy count=%d offset=%d at 0x%X", count, offset, (uint32)(uc->dst - uc->dstStart));
+		return false;
 	}
+	uc->dst -= count;
+	copyBackwards(uc->dst, count, offset);
+	return true;
 }
 
-bool delphine_unpack(uint8 *dst, const uint8 *src, int len) {
-	UnpackCtx uc;
-	uc.src = src + len - 4;
-	uc.datasize = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.dst = dst + uc.datasize - 1;
-	uc.size = 0;
-	uc.crc = READ_BE_UINT32(uc.src); uc.src -= 4;
-	uc.chk = READ_BE_UINT32(uc.src); uc.src -= 4;
-	debug(DBG_UNPACK, "delphine_unpack() crc=0x%X datasize=0x%X", uc.crc, uc.datasize);
-	uc.crc ^= uc.chk;
-	do {
-		if (!next_chunk(&uc)) {
-			uc.size = 1;
-			if (!next_chunk(&uc)) {
-				dec_unk1(&uc, 3, 0);
+bool UnpackCtx::begin(uint8 *dstBuf, const uint8 *srcBuf, int len) {
+	src = srcBuf;
+	srcOffset = -1;
+	dst = dstStart = dstEnd = dstBuf;
+	bits = 0;
+	bitsCount = 0;
+	crc = 0;
+	truncated = false;
+	failed = false;
+	if (len < 12) {
+		debug(DBG_UNPACK, "delphine_unpack() stream too short, %d bytes", len);
+		failed = true;
+		return false;
+	}
+	srcOffset = len - 16;
+	const uint32 datasize = READ_BE_UINT32(src + len - 4);
+	crc = READ_BE_UINT32(src + len - 8);
+	const uint32 chk = READ_BE_UINT32(src + len - 12);
+	debug(DBG_UNPACK, "delphine_unpack() crc=0x%X datasize=0x%X", crc, datasize);
+	crc ^= chk;
+	// the highest bit set of the first word marks the end of its bits
+	if (chk != 0) {
+		bitsCount = 31 - __builtin_clz(chk);
+		bits = (uint64)reverseBits(chk ^ (1U << bitsCount)) << 32;
+	}
+	dstEnd = dst = dstBuf + datasize;
+	return true;
+}
+
+// unpacks until the output reaches 'limit', the last copy or literal run may go below it
+void UnpackCtx::decode(const uint8 *limit) {
+	while (dst > limit && !failed) {
+		bool ret;
+		if (!getCode(this, 1)) {
+			if (!getCode(this, 1)) {
+				ret = dec_unk1(this, getCode(this, 3) + 1);
 			} else {
-				dec_unk2(&uc, 8);
+				ret = dec_unk2(this, 2, getCode(this, 8));
 			}
 		} else {
-			uint16 c = get_code(&uc, 2);
+			const uint32 c = getCode(this, 2);
 			if (c == 3) {
-				dec_unk1(&uc, 8, 8);
+				ret = dec_unk1(this, getCode(this, 8) + 9);
 			} else if (c < 2) {
-				uc.size = c + 2;
-				dec_unk2(&uc, c + 9);
+				ret = dec_unk2(this, c + 3, getCode(this, c + 9));
 			} else {
-				uc.size = get_code(&uc, 8);
-				dec_unk2(&uc, 12);
+				const uint32 count = getCode(this, 8) + 1;
+				ret = dec_unk2(this, count, getCode(this, 12));
 			}
 		}
-	} while (uc.datasize > 0);
-	return uc.crc == 0;
+		failed = !ret;
+	}
+}
+
+bool UnpackCtx::step(uint32 budget) {
+	decode((uint32)(dst - dstStart) > budget ? dst - budget : dstStart);
+	return !failed && dst > dstStart;
+}
+
+bool UnpackCtx::finish() {
+	decode(dstStart);
+	return !failed && !truncated && crc == 0;
+}
+
+bool delphine_unpack(uint8 *dst, const uint8 *src, int len) {
+	UnpackCtx uc;
+	uc.begin(dst, src, len);
+	return uc.finish();
 }
@@ -21,14 +21,27 @@
 #include "intern.h"
 
 
+// Resumable decoder, the output is written backwards from its end : after
+// begin(), each step() unpacks about 'budget' bytes and the bytes from
+// getFinalOffset() to the end of the output will not change anymore.
 struct UnpackCtx {
-	int size, datasize;
+	uint64 bits; // next bits of the stream, starting from the msb
+	int bitsCount;
 	uint32 crc;
-	uint32 chk;
-	uint8 *dst;
+	bool truncated, failed;
+	uint8 *dst, *dstStart, *dstEnd; // written backwards, dst is past the next byte
 	const uint8 *src;
+	int srcOffset; // next word to read, negative once the start of the buffer is reached
+
+	bool begin(uint8 *dstBuf, const uint8 *srcBuf, int len);
+	bool step(uint32 budget); // returns false once the output is complete or the stream is bad
+	bool finish(); // unpacks the rest, returns true if the output is complete and its crc matches
+	void decode(const uint8 *limit);
+	uint32 getFinalOffset() const { return dst - dstStart; }
+	uint32 getSize() const { return dstEnd - dstStart; }
 };
 
+// unpacks the stream ending at src + len, dst must hold the unpacked size stored in its last 4 bytes
 extern bool delphine_unpack(uint8 *dst, const uint8 *src, int len);
 
 
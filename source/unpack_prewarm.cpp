@@ -0,0 +1,82 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cutscene.h"
+#include "file.h"
+#include "resource.h"
+#include "systemstub.h"
+#include "game.h"
+
+// Decompresses the rooms of the loaded Amiga LEV file.
+static void prewarmLevelRooms(Resource *res) {
+	static const uint32 kMemBufSize = 256 * 224;
+	for (int room = 0; room < 64; ++room) {
+		const uint32 offset = READ_BE_UINT32(res->_lev + room * 4);
+		if (offset < 8 || offset > res->_levView.size) {
+			continue;
+		}
+		if (READ_BE_UINT32(res->_lev + offset - 4) > kMemBufSize) {
+			warning("Skipping room %d of '%s', bad size", room, res->_levName);
+			continue;
+		}
+		if (!res->unpack(res->_memBuf, res->_lev, offset, res->_levName, offset)) {
+			warning("Bad CRC for room %d of '%s'", room, res->_levName);
+		}
+	}
+}
+
+// Fills the unpack cache with the data of all the levels and cutscenes,
+// creating its directory if needed.
+void Game::prewarmUnpackCache() {
+	_stub->init("REminiscence", Video::GAMESCREEN_W, Video::GAMESCREEN_H);
+	if (!_res.openUnpackCache(_savePath, true)) {
+		warning("Unable to create the unpack cache directory in '%s'", _savePath);
+		return;
+	}
+	const uint32 start = getTimeStampUs();
+	if (_res._type == kResourceTypeAmiga) {
+		_res.load("PERSO", Resource::OT_SPM);
+		for (uint16 id = 0; id < Cutscene::NUM_CUTSCENES; ++id) {
+			const uint16 cutName = Cutscene::_offsetsTable[id * 2 + 0];
+			if (cutName == 0xFFFF) {
+				continue;
+			}
+			const char *name = Cutscene::_namesTable[cutName & 0xFF];
+			if (strncmp(name, "INTRO", 5) == 0) {
+				name = "INTRO";
+			}
+			char fileName[32];
+			snprintf(fileName, sizeof(fileName), "%s.CMP", name);
+			if (File().open(fileName, "rb", _fs)) {
+				_res.load(name, Resource::OT_CMP);
+			}
+		}
+	}
+	for (_currentLevel = 0; _currentLevel < 7; ++_currentLevel) {
+		startLoadLevelData();
+		finishLoadLevelData();
+		if (_res._type == kResourceTypeAmiga) {
+			prewarmLevelRooms(&_res);
+			if (_currentLevel == 1) {
+				_res.load("level2_2", Resource::OT_LEV);
+				prewarmLevelRooms(&_res);
+			}
+		}
+	}
+	_currentLevel = 0;
+	debug(DBG_INFO, "Unpack cache filled in %d ms", (getTimeStampUs() - start) / 1000);
+}
@@ -16,6 +16,12 @@
  */
 
 #include <cstdarg>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 #include "util.h"
 
 
@@ -52,3 +58,12 @@ void warning(const char *msg, ...) {
 	fprintf(stderr, "WARNING: %s!\n", buf);
 }
 
+uint32 getTimeStampUs() {
+#ifdef _WIN32
+	return GetTickCount() * 1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
@@ -41,5 +41,6 @@ extern uint16 g_debugMask;
 extern void debug(uint16 cm, const char *msg, ...);
 extern void error(const char *msg, ...);
 extern void warning(const char *msg, ...);
+extern uint32 getTimeStampUs(); // for the measures of the code without a SystemStub
 
 #endif // UTIL_H__
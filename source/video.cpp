@@ -15,14 +15,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "capture.h"
 #include "resource.h"
 #include "systemstub.h"
-#include "unpack.h"
 #include "video.h"
 
 
 Video::Video(Resource *res, SystemStub *stub)
-	: _res(res), _stub(stub) {
+	: _res(res), _stub(stub), _capture(0) {
 	_frontLayer = (uint8 *)malloc(GAMESCREEN_W * GAMESCREEN_H);
 	memset(_frontLayer, 0, GAMESCREEN_W * GAMESCREEN_H);
 	_backLayer = (uint8 *)malloc(GAMESCREEN_W * GAMESCREEN_H);
@@ -35,6 +35,10 @@ Video::Video(Resource *res, SystemStub *stub)
 	memset(_screenBlocks, 0, (GAMESCREEN_W / SCREENBLOCK_W) * (GAMESCREEN_H / SCREENBLOCK_H));
 	_fullRefresh = true;
 	_shakeOffset = 0;
+	_digestProc = 0;
+	_digestUserData = 0;
+	_blockDigests = (uint64 *)malloc((GAMESCREEN_W / SCREENBLOCK_W) * (GAMESCREEN_H / SCREENBLOCK_H) * sizeof(uint64));
+	_blockDigestsValid = false;
 	_charFrontColor = 0;
 	_charTransparentColor = 0;
 	_charShadowColor = 0;
@@ -46,6 +50,7 @@ Video::~Video() {
 	free(_tempLayer);
 	free(_tempLayer2);
 	free(_screenBlocks);
+	free(_blockDigests);
 }
 
 void Video::markBlockAsDirty(int16 x, int16 y, uint16 w, uint16 h) {
@@ -66,6 +71,12 @@ void Video::markBlockAsDirty(int16 x, int16 y, uint16 w, uint16 h) {
 void Video::updateScreen() {
 	debug(DBG_VIDEO, "Video::updateScreen()");
 //	_fullRefresh = true;
+	if (_capture) {
+		_capture->captureFrame(_frontLayer, GAMESCREEN_W, _fullRefresh ? 0 : _screenBlocks);
+	}
+	if (_digestProc) {
+		(*_digestProc)(_digestUserData, updateFrameDigest(_fullRefresh ? 0 : _screenBlocks));
+	}
 	if (_fullRefresh) {
 		_stub->copyRect(0, 0, Video::GAMESCREEN_W, Video::GAMESCREEN_H, _frontLayer, 256);
 		_stub->updateScreen(_shakeOffset);
@@ -110,6 +121,83 @@ void Video::fullRefresh() {
 	memset(_screenBlocks, 0, (GAMESCREEN_W / SCREENBLOCK_W) * (GAMESCREEN_H / SCREENBLOCK_H));
 }
 
+void Video::setFrameDigestCallback(FrameDigestProc proc, void *userData) {
+	_digestProc = proc;
+	_digestUserData = userData;
+	_blockDigestsValid = false;
+}
+
+static const uint64 kDigestPrime = 0x100000001B3ULL;
+
+static inline uint64 digestMix(uint64 h, uint64 n) {
+	h = (h ^ n) * kDigestPrime;
+	return h ^ (h >> 29);
+}
+
+// a block row is 8 pixels, hashed as a single 64 bits word
+static uint64 digestBlock(const uint8 *src, int pitch, int num) {
+	uint64 h = digestMix(0xCBF29CE484222325ULL, num);
+	for (int y = 0; y < Video::SCREENBLOCK_H; ++y) {
+		uint64 row;
+		memcpy(&row, src, sizeof(row));
+		h = digestMix(h, row);
+		src += pitch;
+	}
+	return h;
+}
+
+static uint64 digestPalette(SystemStub *stub, uint64 h) {
+	for (int i = 0; i < 256; ++i) {
+		Color c;
+		stub->getPaletteEntry(i, &c);
+		h = digestMix(h, (c.r << 16) | (c.g << 8) | c.b);
+	}
+	return h;
+}
+
+// Digest of the frame as presented by updateScreen : only the blocks copied
+// to the screen this frame are hashed again, a null dirtyBlocks meaning
+// the whole layer.
+uint64 Video::updateFrameDigest(const uint8 *dirtyBlocks) {
+	const int bw = GAMESCREEN_W / SCREENBLOCK_W;
+	const int bh = GAMESCREEN_H / SCREENBLOCK_H;
+	if (!_blockDigestsValid) {
+		dirtyBlocks = 0;
+		_blockDigestsValid = true;
+	}
+	uint64 h = 0;
+	for (int i = 0; i < bw * bh; ++i) {
+		if (!dirtyBlocks || dirtyBlocks[i] != 0) {
+			const uint8 *src = _frontLayer + (i / bw) * SCREENBLOCK_H * GAMESCREEN_W + (i % bw) * SCREENBLOCK_W;
+			_blockDigests[i] = digestBlock(src, GAMESCREEN_W, i);
+		}
+		h = digestMix(h, _blockDigests[i]);
+	}
+	return digestPalette(_stub, h);
+}
+
+// Same digest as updateFrameDigest, for the screens not presented through
+// updateScreen (cutscenes, menus).
+uint64 Video::computeFrameDigest(const uint8 *layer) {
+	const int bw = GAMESCREEN_W / SCREENBLOCK_W;
+	const int bh = GAMESCREEN_H / SCREENBLOCK_H;
+	uint64 h = 0;
+	for (int i = 0; i < bw * bh; ++i) {
+		const uint8 *src = layer + (i / bw) * SCREENBLOCK_H * GAMESCREEN_W + (i % bw) * SCREENBLOCK_W;
+		h = digestMix(h, digestBlock(src, GAMESCREEN_W, i));
+	}
+	return digestPalette(_stub, h);
+}
+
+// Reports a layer presented without updateScreen to the digest callback.
+void Video::digestLayer(const uint8 *layer) {
+	if (_digestProc) {
+		(*_digestProc)(_digestUserData, computeFrameDigest(layer));
+		// the screen no longer matches the block digests
+		_blockDigestsValid = false;
+	}
+}
+
 void Video::fadeOut() {
 	debug(DBG_VIDEO, "Video::fadeOut()");
 	_stub->fadeScreen();
@@ -556,7 +644,7 @@ static void AMIGA_decodeLevHelper(uint8 *dst, const uint8 *src, int offset10, in
 void Video::AMIGA_decodeLev(int level, int room) {
 	uint8 *tmp = _res->_memBuf;
 	const int offset = READ_BE_UINT32(_res->_lev + room * 4);
-	if (!delphine_unpack(tmp, _res->_lev, offset)) {
+	if (!_res->unpack(tmp, _res->_lev, offset, _res->_levName, offset)) {
 		error("Bad CRC for level %d room %d", level, room);
 	}
 	uint16 offset10 = READ_BE_UINT16(tmp + 10);
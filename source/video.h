@@ -20,10 +20,13 @@
 
 #include "intern.h"
 
+struct Capture;
 struct Resource;
 struct SystemStub;
 
 struct Video {
+	typedef void (*FrameDigestProc)(void *userData, uint64 digest);
+
 	enum {
 		GAMESCREEN_W = 256,
 		GAMESCREEN_H = 224,
@@ -40,6 +43,7 @@ struct Video {
 
 	Resource *_res;
 	SystemStub *_stub;
+	Capture *_capture;
 
 	uint8 *_frontLayer;
 	uint8 *_backLayer;
@@ -53,6 +57,10 @@ struct Video {
 	uint8 *_screenBlocks;
 	bool _fullRefresh;
 	uint8 _shakeOffset;
+	FrameDigestProc _digestProc;
+	void *_digestUserData;
+	uint64 *_blockDigests;
+	bool _blockDigestsValid;
 
 	Video(Resource *res, SystemStub *stub);
 	~Video();
@@ -60,6 +68,10 @@ struct Video {
 	void markBlockAsDirty(int16 x, int16 y, uint16 w, uint16 h);
 	void updateScreen();
 	void fullRefresh();
+	void setFrameDigestCallback(FrameDigestProc proc, void *userData);
+	uint64 updateFrameDigest(const uint8 *dirtyBlocks);
+	uint64 computeFrameDigest(const uint8 *layer);
+	void digestLayer(const uint8 *layer);
 	void fadeOut();
 	void fadeOutPalette();
 	void setPaletteColorBE(int num, int offset);
@@ -0,0 +1,178 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts a capture file written by source/capture.cpp into a sequence of
+ * PPM images, and prints the timestamp and phase timings of each frame.
+ *
+ *   g++ -O2 -o capture2ppm tools/capture2ppm.cpp
+ *   capture2ppm [-slow US] FILE [OUTPUT_PREFIX]
+ *
+ * With -slow, only the frames whose logic + draw + present time exceeds
+ * US microseconds are written.
+ *
+ * File layout, all values big endian:
+ *
+ *   header:  'FBCP' u32, version u16, width u16, height u16, block w u8, block h u8
+ *   frame:   flags u8 (1: key frame, 2: palette present)
+ *            timestamp u32 (ms since the capture started)
+ *            logic, draw, present, wait u32 (us, present and wait are
+ *              those of the previous frame)
+ *            palette (if flags & 2): 32 bytes mask of the modified entries,
+ *              then r, g, b (6 bits) for each of them
+ *            blocks count u16, then if not zero: mask of the modified
+ *              blocks (1 bit per block, rows first), then the pixels of
+ *              each block
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool readBytes(FILE *fp, void *buf, size_t len) {
+	return fread(buf, 1, len, fp) == len;
+}
+
+static bool readU8(FILE *fp, uint32_t *n) {
+	uint8_t b;
+	if (!readBytes(fp, &b, 1)) {
+		return false;
+	}
+	*n = b;
+	return true;
+}
+
+static bool readU16(FILE *fp, uint32_t *n) {
+	uint8_t b[2];
+	if (!readBytes(fp, b, 2)) {
+		return false;
+	}
+	*n = (b[0] << 8) | b[1];
+	return true;
+}
+
+static bool readU32(FILE *fp, uint32_t *n) {
+	uint8_t b[4];
+	if (!readBytes(fp, b, 4)) {
+		return false;
+	}
+	*n = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+	return true;
+}
+
+static void writePPM(const char *path, const uint8_t *layer, const uint8_t *pal, int w, int h) {
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		fprintf(stderr, "Unable to write '%s'\n", path);
+		return;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", w, h);
+	for (int i = 0; i < w * h; ++i) {
+		const uint8_t *c = &pal[layer[i] * 3];
+		uint8_t rgb[3];
+		for (int j = 0; j < 3; ++j) {
+			rgb[j] = (c[j] << 2) | (c[j] >> 4);
+		}
+		fwrite(rgb, 1, 3, fp);
+	}
+	fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t slowThreshold = 0;
+	int argi = 1;
+	if (argi + 1 < argc && strcmp(argv[argi], "-slow") == 0) {
+		slowThreshold = strtoul(argv[argi + 1], 0, 10);
+		argi += 2;
+	}
+	if (argi >= argc) {
+		fprintf(stderr, "Usage: %s [-slow US] FILE [OUTPUT_PREFIX]\n", argv[0]);
+		return 1;
+	}
+	const char *prefix = (argi + 1 < argc) ? argv[argi + 1] : "frame";
+	FILE *fp = fopen(argv[argi], "rb");
+	if (!fp) {
+		fprintf(stderr, "Unable to open '%s'\n", argv[argi]);
+		return 1;
+	}
+	uint32_t tag, version, w, h, bw, bh;
+	if (!readU32(fp, &tag) || tag != 0x46424350 || !readU16(fp, &version) || version != 1 ||
+		!readU16(fp, &w) || !readU16(fp, &h) || !readU8(fp, &bw) || !readU8(fp, &bh) ||
+		bw == 0 || bh == 0 || (w % bw) != 0 || (h % bh) != 0) {
+		fprintf(stderr, "'%s' is not a capture file\n", argv[argi]);
+		fclose(fp);
+		return 1;
+	}
+	const uint32_t blocksCount = (w / bw) * (h / bh);
+	uint8_t *layer = (uint8_t *)calloc(w * h, 1);
+	uint8_t *blocksMask = (uint8_t *)malloc((blocksCount + 7) / 8);
+	uint8_t pal[256 * 3];
+	memset(pal, 0, sizeof(pal));
+
+	printf("frame,timestamp,logic,draw,present,wait,blocks,palette\n");
+	int frame = 0;
+	bool synced = false;
+	uint32_t flags;
+	while (readU8(fp, &flags)) {
+		uint32_t timestamp, phases[4], count;
+		bool err = !readU32(fp, &timestamp);
+		for (int i = 0; i < 4; ++i) {
+			err = err || !readU32(fp, &phases[i]);
+		}
+		int palCount = 0;
+		if (!err && (flags & 2)) {
+			uint8_t palMask[32];
+			err = !readBytes(fp, palMask, 32);
+			for (int i = 0; i < 256 && !err; ++i) {
+				if (palMask[i >> 3] & (1 << (i & 7))) {
+					err = !readBytes(fp, &pal[i * 3], 3);
+					++palCount;
+				}
+			}
+		}
+		err = err || !readU16(fp, &count);
+		if (!err && count != 0) {
+			err = !readBytes(fp, blocksMask, (blocksCount + 7) / 8);
+			for (uint32_t i = 0; i < blocksCount && !err; ++i) {
+				if (blocksMask[i >> 3] & (1 << (i & 7))) {
+					uint8_t *dst = layer + (i / (w / bw)) * bh * w + (i % (w / bw)) * bw;
+					for (uint32_t y = 0; y < bh && !err; ++y) {
+						err = !readBytes(fp, dst + y * w, bw);
+					}
+				}
+			}
+		}
+		if (err) {
+			fprintf(stderr, "Truncated frame %d\n", frame);
+			break;
+		}
+		// frames before the first key frame follow a dropped frame
+		synced = synced || (flags & 1) != 0;
+		printf("%d,%u,%u,%u,%u,%u,%u,%d\n", frame, timestamp, phases[0], phases[1], phases[2], phases[3], count, palCount);
+		if (synced && phases[0] + phases[1] + phases[2] >= slowThreshold) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s%05d.ppm", prefix, frame);
+			writePPM(path, layer, pal, w, h);
+		}
+		++frame;
+	}
+	free(layer);
+	free(blocksMask);
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,233 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Packs the game data files into the single archive read by source/archive.cpp.
+ *
+ *   g++ -O2 -Isource -o fbpack tools/fbpack.cpp source/archive.cpp source/unpack.cpp source/util.cpp
+ *   fbpack [-u] DATA_DIR [OUTPUT]
+ *
+ * The files of DATA_DIR and its sub directories are stored under their base
+ * name, OUTPUT defaults to DATA_DIR/FLASHBACK.PAK which is where the game
+ * looks for it.
+ *
+ * With -u, the .CT, .SGD and .SPM files, which are compressed as a whole,
+ * are also stored decompressed so the loaders can read them directly.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "archive.h"
+#include "unpack.h"
+
+struct PackEntry {
+	std::string name;
+	std::string path;
+	uint32 hash;
+	uint32 flags;
+	std::vector<uint8> data;
+};
+
+static std::string upperName(const std::string &s) {
+	std::string u(s);
+	for (size_t i = 0; i < u.size(); ++i) {
+		u[i] = toupper((uint8)u[i]);
+	}
+	return u;
+}
+
+static bool compareEntries(const PackEntry &a, const PackEntry &b) {
+	if (a.hash != b.hash) {
+		return a.hash < b.hash;
+	}
+	if (a.flags != b.flags) {
+		return a.flags < b.flags;
+	}
+	return upperName(a.name) < upperName(b.name);
+}
+
+static bool readFile(const char *path, std::vector<uint8> &data) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	data.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	const bool ret = data.empty() || fread(&data[0], 1, data.size(), fp) == data.size();
+	fclose(fp);
+	return ret;
+}
+
+static void scanDirectory(const std::string &dir, std::vector<PackEntry> &entries) {
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		fprintf(stderr, "Unable to open directory '%s'\n", dir.c_str());
+		return;
+	}
+	dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		const std::string path = dir + "/" + de->d_name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			scanDirectory(path, entries);
+		} else if (upperName(de->d_name) != "FLASHBACK.PAK") {
+			PackEntry e;
+			e.name = de->d_name;
+			e.path = path;
+			e.hash = Archive::hashName(de->d_name);
+			e.flags = 0;
+			entries.push_back(e);
+		}
+	}
+	closedir(d);
+}
+
+static bool isPackedFile(const std::string &name) {
+	const size_t dot = name.rfind('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+	const std::string ext = upperName(name.substr(dot + 1));
+	return ext == "CT" || ext == "SGD" || ext == "SPM";
+}
+
+static void writeUint16LE(std::vector<uint8> &buf, uint32 n) {
+	buf.push_back(n & 255);
+	buf.push_back(n >> 8);
+}
+
+static void writeUint32LE(std::vector<uint8> &buf, uint32 n) {
+	writeUint16LE(buf, n & 0xFFFF);
+	writeUint16LE(buf, n >> 16);
+}
+
+int main(int argc, char *argv[]) {
+	int argi = 1;
+	bool unpacked = false;
+	if (argi < argc && strcmp(argv[argi], "-u") == 0) {
+		unpacked = true;
+		++argi;
+	}
+	if (argi >= argc) {
+		fprintf(stderr, "Usage: %s [-u] DATA_DIR [OUTPUT]\n", argv[0]);
+		return 1;
+	}
+	const std::string dataDir = argv[argi];
+	const std::string output = (argi + 1 < argc) ? argv[argi + 1] : dataDir + "/FLASHBACK.PAK";
+
+	std::vector<PackEntry> entries;
+	scanDirectory(dataDir, entries);
+	std::sort(entries.begin(), entries.end(), compareEntries);
+	for (size_t i = 1; i < entries.size(); ) {
+		if (entries[i].hash == entries[i - 1].hash && upperName(entries[i].name) == upperName(entries[i - 1].name)) {
+			fprintf(stderr, "Ignoring '%s', same name as '%s'\n", entries[i].path.c_str(), entries[i - 1].path.c_str());
+			entries.erase(entries.begin() + i);
+		} else {
+			++i;
+		}
+	}
+
+	const size_t filesCount = entries.size();
+	for (size_t i = 0; i < filesCount; ++i) {
+		PackEntry &e = entries[i];
+		if (!readFile(e.path.c_str(), e.data)) {
+			fprintf(stderr, "Unable to read '%s'\n", e.path.c_str());
+			return 1;
+		}
+		if (unpacked && isPackedFile(e.name) && e.data.size() >= 8) {
+			const uint32 size = READ_BE_UINT32(&e.data[e.data.size() - 4]);
+			if (size == 0 || size > (1 << 24)) {
+				fprintf(stderr, "Bad unpacked size for '%s', not storing it unpacked\n", e.path.c_str());
+				continue;
+			}
+			PackEntry u;
+			u.name = e.name;
+			u.hash = e.hash;
+			u.flags = Archive::ENTRY_UNPACKED;
+			u.data.resize(size);
+			if (!delphine_unpack(&u.data[0], &e.data[0], e.data.size())) {
+				fprintf(stderr, "Bad CRC for '%s', not storing it unpacked\n", e.path.c_str());
+				continue;
+			}
+			entries.push_back(u);
+		}
+	}
+	std::sort(entries.begin(), entries.end(), compareEntries);
+
+	std::vector<uint8> names;
+	std::vector<uint32> nameOffsets;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		nameOffsets.push_back(names.size());
+		names.insert(names.end(), entries[i].name.begin(), entries[i].name.end());
+		names.push_back(0);
+	}
+	const uint32 tocSize = entries.size() * Archive::ENTRY_SIZE + names.size();
+	uint32 dataOffset = Archive::HEADER_SIZE + tocSize;
+
+	std::vector<uint8> toc;
+	toc.insert(toc.end(), "FBPK", "FBPK" + 4);
+	writeUint16LE(toc, Archive::VERSION);
+	writeUint16LE(toc, 0);
+	writeUint32LE(toc, entries.size());
+	writeUint32LE(toc, tocSize);
+	std::vector<uint32> dataOffsets;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		dataOffset = (dataOffset + Archive::DATA_ALIGN - 1) & ~(Archive::DATA_ALIGN - 1);
+		dataOffsets.push_back(dataOffset);
+		writeUint32LE(toc, entries[i].hash);
+		writeUint32LE(toc, nameOffsets[i]);
+		writeUint32LE(toc, dataOffset);
+		writeUint32LE(toc, entries[i].data.size());
+		writeUint32LE(toc, entries[i].flags);
+		dataOffset += entries[i].data.size();
+	}
+	toc.insert(toc.end(), names.begin(), names.end());
+
+	FILE *fp = fopen(output.c_str(), "wb");
+	if (!fp) {
+		fprintf(stderr, "Unable to write '%s'\n", output.c_str());
+		return 1;
+	}
+	fwrite(&toc[0], 1, toc.size(), fp);
+	uint32 pos = toc.size();
+	static const uint8 padding[Archive::DATA_ALIGN] = { 0 };
+	for (size_t i = 0; i < entries.size(); ++i) {
+		fwrite(padding, 1, dataOffsets[i] - pos, fp);
+		if (!entries[i].data.empty()) {
+			fwrite(&entries[i].data[0], 1, entries[i].data.size(), fp);
+		}
+		pos = dataOffsets[i] + entries[i].data.size();
+	}
+	const bool ioErr = ferror(fp) != 0;
+	fclose(fp);
+	if (ioErr) {
+		fprintf(stderr, "I/O error when writing '%s'\n", output.c_str());
+		return 1;
+	}
+	printf("Packed %d files (%d entries) into '%s', %d bytes\n", (int)filesCount, (int)entries.size(), output.c_str(), pos);
+	return 0;
+}
@@ -0,0 +1,426 @@
+/* REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2011 Gregory Montoir
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks delphine_unpack() against the original bit by bit decoder and
+ * measures their throughput.
+ *
+ *   g++ -O2 -Isource -o unpackbench tools/unpackbench.cpp source/unpack.cpp source/util.cpp
+ *   unpackbench DATA_DIR [REPEAT]
+ *   unpackbench -fuzz ITERATIONS [DATA_DIR]
+ *
+ * Every packed stream of the .CT, .SGD, .SPM, .OBC, .CMP, .LEV and .MBK
+ * files of DATA_DIR is unpacked by both decoders, which must return the same
+ * bytes, also when unpacked in slices with UnpackCtx::step(). Then each
+ * decoder unpacks all the streams REPEAT times (10).
+ *
+ * With -fuzz, the streams of DATA_DIR, or random data without it, are
+ * damaged and unpacked in buffers of the exact size. Build with
+ * -fsanitize=address to catch the accesses out of them.
+ */
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "unpack.h"
+
+struct RefUnpackCtx {
+	int size, datasize;
+	uint32 crc;
+	uint32 chk;
+	uint8 *dst;
+	const uint8 *src;
+};
+
+static int rcr(RefUnpackCtx *uc, int CF) {
+	int rCF = (uc->chk & 1);
+	uc->chk >>= 1;
+	if (CF) {
+		uc->chk |= 0x80000000;
+	}
+	return rCF;
+}
+
+static int next_chunk(RefUnpackCtx *uc) {
+	int CF = rcr(uc, 0);
+	if (uc->chk == 0) {
+		uc->chk = READ_BE_UINT32(uc->src); uc->src -= 4;
+		uc->crc ^= uc->chk;
+		CF = rcr(uc, 1);
+	}
+	return CF;
+}
+
+static uint16 get_code(RefUnpackCtx *uc, uint8 num_chunks) {
+	uint16 c = 0;
+	while (num_chunks--) {
+		c <<= 1;
+		if (next_chunk(uc)) {
+			c |= 1;
+		}
+	}
+	return c;
+}
+
+static void dec_unk1(RefUnpackCtx *uc, uint8 num_chunks, uint8 add_count) {
+	uint16 count = get_code(uc, num_chunks) + add_count + 1;
+	uc->datasize -= count;
+	while (count--) {
+		*uc->dst = (uint8)get_code(uc, 8);
+		--uc->dst;
+	}
+}
+
+static void dec_unk2(RefUnpackCtx *uc, uint8 num_chunks) {
+	uint16 i = get_code(uc, num_chunks);
+	uint16 count = uc->size + 1;
+	uc->datasize -= count;
+	while (count--) {
+		*uc->dst = *(uc->dst + i);
+		--uc->dst;
+	}
+}
+
+// the decoder of source/unpack.cpp before the bit buffer, only safe on valid streams
+static bool reference_unpack(uint8 *dst, const uint8 *src, int len) {
+	RefUnpackCtx uc;
+	uc.src = src + len - 4;
+	uc.datasize = READ_BE_UINT32(uc.src); uc.src -= 4;
+	uc.dst = dst + uc.datasize - 1;
+	uc.size = 0;
+	uc.crc = READ_BE_UINT32(uc.src); uc.src -= 4;
+	uc.chk = READ_BE_UINT32(uc.src); uc.src -= 4;
+	uc.crc ^= uc.chk;
+	do {
+		if (!next_chunk(&uc)) {
+			uc.size = 1;
+			if (!next_chunk(&uc)) {
+				dec_unk1(&uc, 3, 0);
+			} else {
+				dec_unk2(&uc, 8);
+			}
+		} else {
+			uint16 c = get_code(&uc, 2);
+			if (c == 3) {
+				dec_unk1(&uc, 8, 8);
+			} else if (c < 2) {
+				uc.size = c + 2;
+				dec_unk2(&uc, c + 9);
+			} else {
+				uc.size = get_code(&uc, 8);
+				dec_unk2(&uc, 12);
+			}
+		}
+	} while (uc.datasize > 0);
+	return uc.crc == 0;
+}
+
+struct DataFile {
+	std::string name;
+	std::vector<uint8> data;
+};
+
+struct PackedStream {
+	int file;
+	uint32 start, len; // the stream ends at start + len, the decoders may read back to start
+	uint32 size;
+	std::string desc;
+};
+
+enum {
+	MAX_UNPACKED_SIZE = 1 << 24
+};
+
+static std::vector<DataFile> _files;
+static std::vector<PackedStream> _streams;
+
+static std::string upperName(const std::string &s) {
+	std::string u(s);
+	for (size_t i = 0; i < u.size(); ++i) {
+		u[i] = toupper((uint8)u[i]);
+	}
+	return u;
+}
+
+static bool readFile(const char *path, std::vector<uint8> &data) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	data.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	const bool ret = data.empty() || fread(&data[0], 1, data.size(), fp) == data.size();
+	fclose(fp);
+	return ret;
+}
+
+static void addStream(int file, uint32 start, uint32 len, const char *fmt, ...) {
+	const std::vector<uint8> &data = _files[file].data;
+	if (len < 12 || start + len > data.size()) {
+		return;
+	}
+	const uint32 size = READ_BE_UINT32(&data[start + len - 4]);
+	if (size == 0 || size > MAX_UNPACKED_SIZE) {
+		return;
+	}
+	char buf[64];
+	va_list va;
+	va_start(va, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+	PackedStream s;
+	s.file = file;
+	s.start = start;
+	s.len = len;
+	s.size = size;
+	s.desc = _files[file].name + buf;
+	_streams.push_back(s);
+}
+
+static void addFileStreams(int file) {
+	const std::string &name = _files[file].name;
+	const size_t dot = name.rfind('.');
+	if (dot == std::string::npos) {
+		return;
+	}
+	const std::string ext = upperName(name.substr(dot + 1));
+	const std::vector<uint8> &data = _files[file].data;
+	const uint32 dataSize = data.size();
+	if (dataSize < 12) {
+		return;
+	}
+	if (ext == "CT" || ext == "SGD" || ext == "SPM") {
+		addStream(file, 0, dataSize, "");
+	} else if (ext == "OBC") {
+		addStream(file, 4, READ_BE_UINT32(&data[0]), "");
+	} else if (ext == "CMP") {
+		uint32 offset = 0;
+		for (int i = 0; i < 2 && offset + 4 <= dataSize; ++i) {
+			int packedSize = (int32)READ_BE_UINT32(&data[offset]); offset += 4;
+			if (packedSize < 0) {
+				packedSize = -packedSize;
+			} else {
+				addStream(file, offset, packedSize, ":%d", i);
+			}
+			offset += packedSize;
+		}
+	} else if (ext == "LEV") {
+		for (int room = 0; room < 64 && (room + 1) * 4 <= (int)dataSize; ++room) {
+			const uint32 offset = READ_BE_UINT32(&data[room * 4]);
+			if (offset != 0) {
+				addStream(file, 0, offset, ":room%d", room);
+			}
+		}
+	} else if (ext == "MBK") {
+		// the first byte of the PC files is the count of entries, the Amiga offsets are 32 bits
+		const bool pc = data[0] != 0;
+		const uint32 count = pc ? data[0] : READ_BE_UINT32(&data[0]) / 6;
+		for (uint32 i = 0; i < count && (i + 1) * 6 <= dataSize; ++i) {
+			uint32 offset = READ_BE_UINT32(&data[i * 6]);
+			if (pc) {
+				offset &= 0xFFFF;
+			}
+			if ((READ_BE_UINT16(&data[i * 6 + 4]) & 0x8000) == 0) {
+				addStream(file, 0, offset, ":%d", i);
+			}
+		}
+	}
+}
+
+static void scanDirectory(const std::string &dir) {
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		fprintf(stderr, "Unable to open directory '%s'\n", dir.c_str());
+		return;
+	}
+	dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		const std::string path = dir + "/" + de->d_name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			scanDirectory(path);
+		} else {
+			DataFile f;
+			f.name = de->d_name;
+			if (!readFile(path.c_str(), f.data)) {
+				fprintf(stderr, "Unable to read '%s'\n", path.c_str());
+				continue;
+			}
+			_files.push_back(f);
+			addFileStreams(_files.size() - 1);
+		}
+	}
+	closedir(d);
+}
+
+static const uint8 *streamData(const PackedStream &s) {
+	return &_files[s.file].data[s.start];
+}
+
+static uint32 _rndSeed = 0x12345678;
+
+static uint32 getRandomNumber() {
+	_rndSeed = _rndSeed * 1103515245 + 12345;
+	return _rndSeed >> 8;
+}
+
+// unpacks in random slices, the part of the output said final must already match the reference
+static bool compareSlices(const PackedStream &s, const uint8 *ref, uint8 *out) {
+	memset(out, 0xCC, s.size);
+	UnpackCtx uc;
+	uc.begin(out, streamData(s), s.len);
+	uint32 offset = uc.getFinalOffset();
+	while (uc.step(1 + getRandomNumber() % 4096)) {
+		if (uc.getFinalOffset() >= offset) {
+			return false;
+		}
+		offset = uc.getFinalOffset();
+		if (memcmp(out + offset, ref + offset, s.size - offset) != 0) {
+			return false;
+		}
+	}
+	return uc.finish() && memcmp(out, ref, s.size) == 0;
+}
+
+static int compareDecoders() {
+	int errors = 0;
+	uint32 totalSize = 0, maxSize = 0;
+	for (size_t i = 0; i < _streams.size(); ++i) {
+		maxSize = MAX(maxSize, _streams[i].size);
+	}
+	std::vector<uint8> ref(maxSize), out(maxSize);
+	for (size_t i = 0; i < _streams.size(); ++i) {
+		const PackedStream &s = _streams[i];
+		const bool refRet = reference_unpack(&ref[0], streamData(s), s.len);
+		const bool outRet = delphine_unpack(&out[0], streamData(s), s.len);
+		if (refRet != outRet || memcmp(&ref[0], &out[0], s.size) != 0) {
+			fprintf(stderr, "Mismatch for '%s', crc %d/%d\n", s.desc.c_str(), refRet, outRet);
+			++errors;
+		} else if (!refRet) {
+			fprintf(stderr, "Bad CRC for '%s'\n", s.desc.c_str());
+		} else if (!compareSlices(s, &ref[0], &out[0])) {
+			fprintf(stderr, "Mismatch for '%s' unpacked in slices\n", s.desc.c_str());
+			++errors;
+		}
+		totalSize += s.size;
+	}
+	printf("%d streams, %d bytes unpacked, %d mismatches\n", (int)_streams.size(), totalSize, errors);
+	return errors;
+}
+
+static void benchmarkDecoder(const char *name, bool (*unpackProc)(uint8 *, const uint8 *, int), int repeat) {
+	uint32 maxSize = 0;
+	for (size_t i = 0; i < _streams.size(); ++i) {
+		maxSize = MAX(maxSize, _streams[i].size);
+	}
+	std::vector<uint8> out(maxSize);
+	double totalSize = 0;
+	const uint32 startUs = getTimeStampUs();
+	for (int r = 0; r < repeat; ++r) {
+		for (size_t i = 0; i < _streams.size(); ++i) {
+			const PackedStream &s = _streams[i];
+			unpackProc(&out[0], streamData(s), s.len);
+			totalSize += s.size;
+		}
+	}
+	const uint32 durationUs = MAX(getTimeStampUs() - startUs, 1U);
+	printf("%-10s %8d ms %8.2f MB/s\n", name, durationUs / 1000, totalSize / durationUs);
+}
+
+static void fuzzDecoder(int iterations) {
+	int crcOk = 0;
+	std::vector<uint8> buf;
+	for (int i = 0; i < iterations; ++i) {
+		if (_streams.empty()) {
+			buf.resize(12 + getRandomNumber() % 4096);
+			for (size_t j = 0; j < buf.size(); ++j) {
+				buf[j] = getRandomNumber();
+			}
+		} else {
+			const PackedStream &s = _streams[getRandomNumber() % _streams.size()];
+			buf.assign(streamData(s), streamData(s) + s.len);
+			const int damage = 1 + getRandomNumber() % 8;
+			for (int j = 0; j < damage; ++j) {
+				// most of the damage near the end of the stream, where the decoding starts
+				const uint32 range = (getRandomNumber() & 1) ? MIN((uint32)buf.size(), 256U) : buf.size();
+				buf[buf.size() - 1 - getRandomNumber() % range] ^= 1 << (getRandomNumber() & 7);
+			}
+			if ((getRandomNumber() & 3) == 0) {
+				buf.erase(buf.begin(), buf.begin() + getRandomNumber() % buf.size());
+			}
+		}
+		if (buf.size() < 12) {
+			continue;
+		}
+		uint32 size = READ_BE_UINT32(&buf[buf.size() - 4]);
+		if (size > (1 << 20)) {
+			size &= 0xFFFF;
+			buf[buf.size() - 4] = buf[buf.size() - 3] = 0;
+		}
+		// exact sizes, so any access out of the buffers is reported by the sanitizers
+		uint8 *src = (uint8 *)malloc(buf.size());
+		uint8 *dst = (uint8 *)malloc(size ? size : 1);
+		memcpy(src, &buf[0], buf.size());
+		UnpackCtx uc;
+		uc.begin(dst, src, buf.size());
+		if (getRandomNumber() & 1) {
+			while (uc.step(1 + getRandomNumber() % 1024)) {
+			}
+		}
+		if (uc.finish()) {
+			++crcOk;
+		}
+		free(dst);
+		free(src);
+	}
+	printf("%d streams fuzzed, %d passed the crc check\n", iterations, crcOk);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc >= 3 && strcmp(argv[1], "-fuzz") == 0) {
+		if (argc >= 4) {
+			scanDirectory(argv[3]);
+		}
+		fuzzDecoder(atoi(argv[2]));
+		return 0;
+	}
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s DATA_DIR [REPEAT]\n       %s -fuzz ITERATIONS [DATA_DIR]\n", argv[0], argv[0]);
+		return 1;
+	}
+	scanDirectory(argv[1]);
+	if (_streams.empty()) {
+		fprintf(stderr, "No packed stream found in '%s'\n", argv[1]);
+		return 1;
+	}
+	if (compareDecoders() != 0) {
+		return 1;
+	}
+	const int repeat = (argc >= 3) ? atoi(argv[2]) : 10;
+	benchmarkDecoder("reference", reference_unpack, repeat);
+	benchmarkDecoder("unpack", delphine_unpack, repeat);
+	return 0;
+}